@@ -6,8 +6,7 @@ class AABB
 {
 public:
 	AABB();
-	AABB(const Point3 &top_left, Point3 &down_right);
-	~AABB();
+	AABB(const Point3 &top_left, const Point3 &down_right);
 
 	bool intersection(const AABB *box);
 
@@ -35,12 +34,7 @@ inline AABB::AABB() : top_left({ 0,0,0 }), down_right({ 0, 0, 0 })
 }
 
 
-AABB::AABB(const Point3 &top_left, Point3 &down_right) : top_left(top_left), down_right(down_right)
-{
-}
-
-
-AABB::~AABB()
+inline AABB::AABB(const Point3 &top_left, const Point3 &down_right) : top_left(top_left), down_right(down_right)
 {
 }
 
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "color.h"
+#include <vector>
+#include <stdint.h>
+
+
+// Samples added to a pixel in one adaptive round
+#define ADAPTIVE_BATCH 4
+// Luminance error of pixels darker than this is measured against it, noise in black is hardly visible
+#define ADAPTIVE_DARK_LUMINANCE 16.0f
+
+
+struct AdaptiveSettings
+{
+	int minSamples = 4;				// every pixel gets these first
+	int maxSamples = 64;
+	float threshold = 0.02f;		// pixel stops when standard error of its luminance is below threshold * luminance
+	uint64_t sampleBudget = 0;		// samples of the whole frame, 0 for no limit
+};
+
+
+// Running sum of samples of one pixel
+struct PixelEstimate
+{
+	PixelEstimate() : sum(0, 0, 0), luminanceSum(0), luminanceSquareSum(0), count(0)
+	{
+		;
+	}
+
+	void add(const Color &sample)
+	{
+		sum += sample;
+
+		// variance of what can be displayed, a directly seen light source is white however bright it is
+		float luminance = (min(sample.r, 255.0f) + min(sample.g, 255.0f) + min(sample.b, 255.0f)) / 3.0f;
+		luminanceSum += luminance;
+		luminanceSquareSum += luminance * luminance;
+
+		++count;
+	}
+
+	Color getMean() const
+	{
+		return count > 0 ? sum / (float)count : Color(0, 0, 0);
+	}
+
+	// Standard error of mean luminance relative to the luminance
+	float getRelativeError() const
+	{
+		if (count < 2) return FLT_MAX;
+
+		float mean = luminanceSum / count;
+		float variance = max(luminanceSquareSum / count - mean * mean, 0.0f) * count / (count - 1);
+
+		return sqrtf(variance / count) / max(mean, ADAPTIVE_DARK_LUMINANCE);
+	}
+
+	Color sum;
+	float luminanceSum;
+	float luminanceSquareSum;
+	int count;
+};
+
+
+// Sample count of every pixel as gray, maxSamples is white
+inline void sampleCountImage(const std::vector<PixelEstimate> &estimates, int maxSamples, UINT32 *bitmap)
+{
+	for (size_t i = 0; i < estimates.size(); ++i)
+	{
+		UINT32 gray = (UINT32)min(estimates[i].count * 255 / max(maxSamples, 1), 255);
+		bitmap[i] = (gray << 16) | (gray << 8) | gray;
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <new>
+#include <type_traits>
+#include <stdint.h>
+
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 64
+
+
+/*
+	Bump allocator for objects living as long as their owner, objects created one after
+	another are packed next to each other. Nothing is freed alone, reset() rewinds to the
+	first block in O(1) and keeps memory for reuse, release() gives every block back.
+
+	Destructors never run, so only trivially destructible types can be created.
+	Alignment above ARENA_ALIGNMENT is not supported.
+*/
+class Arena
+{
+public:
+	Arena() {}
+
+	~Arena()
+	{
+		release();
+	}
+
+	Arena(const Arena &) = delete;
+	Arena &operator=(const Arena &) = delete;
+
+	void *allocate(size_t size, size_t alignment);
+
+	template <typename T, typename... Args>
+	T *create(Args&&... args)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "arena never runs destructors");
+		return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+	}
+
+	void reset()
+	{
+		current = 0;
+		offset = 0;
+		usedBytes = 0;
+	}
+
+	void release();
+
+	// Bytes handed out since last reset
+	size_t getUsedBytes() const
+	{
+		return usedBytes;
+	}
+
+	// Bytes held from system
+	size_t getReservedBytes() const
+	{
+		size_t reserved = 0;
+
+		for (const Block &block : blocks)
+		{
+			reserved += block.size;
+		}
+
+		return reserved;
+	}
+
+private:
+	struct Block
+	{
+		char *data;
+		size_t size;
+	};
+
+	std::vector<Block> blocks;
+	size_t current = 0;			// block being filled
+	size_t offset = 0;			// first free byte of current block
+	size_t usedBytes = 0;
+};
+
+
+inline void *Arena::allocate(size_t size, size_t alignment)
+{
+	for (;;)
+	{
+		if (current < blocks.size())
+		{
+			size_t start = (offset + alignment - 1) & ~(alignment - 1);
+
+			if (start + size <= blocks[current].size)
+			{
+				offset = start + size;
+				usedBytes += size;
+				return blocks[current].data + start;
+			}
+
+			// next block was kept by reset() and is big enough
+			if (current + 1 < blocks.size() && size <= blocks[current + 1].size)
+			{
+				++current;
+				offset = 0;
+				continue;
+			}
+		}
+
+		// blocks are aligned to ARENA_ALIGNMENT, so an empty block fits any smaller alignment
+		Block block;
+		block.size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+		blocks.reserve(blocks.size() + 1); // insert below must not throw once the block is allocated
+		block.data = (char *)_mm_malloc(block.size, ARENA_ALIGNMENT);
+		if (block.data == nullptr)
+			throw std::bad_alloc();
+
+		current = blocks.empty() ? 0 : current + 1;
+		blocks.insert(blocks.begin() + current, block);
+		offset = 0;
+	}
+}
+
+
+inline void Arena::release()
+{
+	for (Block &block : blocks)
+	{
+		_mm_free(block.data);
+	}
+
+	blocks.clear();
+	reset();
+}
@@ -0,0 +1,266 @@
+#include "stdafx.h"
+
+#include "tracer.h"
+#include "scence.h"
+#include "demoScence.h"
+
+#include <chrono>
+#include <string>
+#include <string.h>
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+
+/*
+	Render a fixed set of scences at fixed settings, once per thread count from 1 to N,
+	and write the timing to JSON so results of different commits can be compared.
+*/
+
+struct BenchOptions
+{
+	int width = 640;
+	int height = 360;
+	int depth = 8;
+	int antiAliasScale = 1;
+	int maxThreads = TileScheduler::defaultThreadCount();
+	int repeat = 3;
+	const char *filter = nullptr;
+	const char *output = "bench.json";
+};
+
+
+struct BenchScence
+{
+	const char *name;
+	int triangleCount;		// 0 for the demo scence
+	bool withSphereGrid;
+	int lightCount;			// small lights added under the ceiling
+};
+
+
+struct BenchRun
+{
+	int threads;
+	double frameMs;			// median of repeats
+	TracePhaseTimes phases;	// of the median frame
+	uint64_t cameraRays;
+	uint64_t rays;			// every ray type, 0 without USE_RENDER_STATS
+};
+
+
+struct BenchResult
+{
+	const char *name;
+	size_t objectCount;
+	size_t memoryBytes;		// scence after build
+	double generateMs;
+	double buildMs;
+	std::vector<BenchRun> runs;
+};
+
+
+static const BenchScence benchScences[] = {
+	{ "demo", 0, false, 0 },
+	{ "sphere_grid", 0, true, 0 },
+	{ "mesh_10k", 10000, false, 0 },
+	{ "mesh_100k", 100000, false, 0 },
+	{ "mesh_1m", 1000000, false, 0 },
+	{ "lights_16", 0, false, 16 },
+	{ "lights_256", 0, false, 256 },
+};
+
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+void printUsage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -w <width>      image width, default 640\n"
+		"  -h <height>     image height, default 360\n"
+		"  -d <depth>      trace depth, default 8\n"
+		"  -a <scale>      anti alias scale, default 1\n"
+		"  -t <threads>    largest thread count of scaling curve, default all cores\n"
+		"  -r <repeat>     frames per thread count, median is reported, default 3\n"
+		"  -s <name>       only run scences whose name contains <name>\n"
+		"  -o <file>       json output, default bench.json\n",
+		program);
+}
+
+
+bool parseOptions(int argc, char *argv[], BenchOptions &options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+
+		if (arg[0] != '-' || strlen(arg) != 2 || i + 1 >= argc) return false;
+
+		const char *value = argv[++i];
+
+		switch (arg[1])
+		{
+		case 'w': options.width = atoi(value); break;
+		case 'h': options.height = atoi(value); break;
+		case 'd': options.depth = atoi(value); break;
+		case 'a': options.antiAliasScale = atoi(value); break;
+		case 't': options.maxThreads = atoi(value); break;
+		case 'r': options.repeat = atoi(value); break;
+		case 's': options.filter = value; break;
+		case 'o': options.output = value; break;
+		default: return false;
+		}
+	}
+
+	return options.width > 0 && options.height > 0 && options.depth > 0 &&
+		options.antiAliasScale > 0 && options.maxThreads > 0 && options.repeat > 0;
+}
+
+
+BenchResult runScence(const BenchScence &bench, const BenchOptions &options)
+{
+	BenchResult result;
+	result.name = bench.name;
+
+	Scence scence;
+
+	auto start = std::chrono::steady_clock::now();
+
+	if (bench.triangleCount > 0)
+	{
+		buildMeshScence(scence, bench.triangleCount);
+	}
+	else
+	{
+		buildDemoScence(scence, bench.withSphereGrid);
+	}
+
+	addLightGrid(scence, bench.lightCount);
+
+	result.generateMs = elapsedMs(start);
+	result.objectCount = scence.getAllObjects().size();
+
+	start = std::chrono::steady_clock::now();
+	scence.build();
+	result.buildMs = elapsedMs(start);
+	result.memoryBytes = scence.getMemoryBytes();
+
+	Camera camera = createDemoCamera(options.width, options.height);
+	std::vector<UINT32> bitmap(options.width * options.height);
+
+	Tracer rayTracer;
+	rayTracer.setSence(&scence);
+
+	for (int threads = 1; threads <= options.maxThreads; ++threads)
+	{
+		rayTracer.setThreadCount(threads);
+
+		std::vector<BenchRun> frames;
+
+		for (int i = 0; i < options.repeat; ++i)
+		{
+			BenchRun frame;
+			frame.threads = threads;
+
+			start = std::chrono::steady_clock::now();
+			RenderStats stats = rayTracer.trace(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), options.antiAliasScale, bitmap.data());
+			frame.frameMs = elapsedMs(start);
+
+			frame.phases = rayTracer.getPhaseTimes();
+			frame.cameraRays = rayTracer.getCameraRayCount();
+			frame.rays = stats.getRays();
+			frames.push_back(frame);
+		}
+
+		std::sort(frames.begin(), frames.end(), [](const BenchRun &a, const BenchRun &b) { return a.frameMs < b.frameMs; });
+
+		BenchRun run = frames[frames.size() / 2];
+
+		printf("%-12s %8zu objects  build %9.1f ms  %3d threads  %9.1f ms/frame (tiles %.1f, tonemap %.1f)  %12.0f rays/s  x%.2f\n",
+			bench.name, result.objectCount, result.buildMs, threads, run.frameMs, run.phases.tilesMs, run.phases.tonemapMs,
+			run.rays / (run.frameMs / 1000.0), result.runs.empty() ? 1.0 : result.runs[0].frameMs / run.frameMs);
+		fflush(stdout);
+
+		result.runs.push_back(run);
+	}
+
+	return result;
+}
+
+
+bool writeJson(const char *path, const BenchOptions &options, const std::vector<BenchResult> &results)
+{
+	FILE *file = fopen(path, "w");
+	if (file == nullptr) return false;
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"commit\": \"%s\",\n", BENCH_COMMIT);
+	fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n  \"depth\": %d,\n  \"anti_alias_scale\": %d,\n  \"repeat\": %d,\n",
+		options.width, options.height, options.depth, options.antiAliasScale, options.repeat);
+	fprintf(file, "  \"scences\": [\n");
+
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		const BenchResult &result = results[i];
+
+		fprintf(file, "    {\n");
+		fprintf(file, "      \"name\": \"%s\",\n", result.name);
+		fprintf(file, "      \"objects\": %zu,\n", result.objectCount);
+		fprintf(file, "      \"scence_bytes\": %zu,\n", result.memoryBytes);
+		fprintf(file, "      \"phases_ms\": { \"generate\": %.3f, \"build\": %.3f },\n", result.generateMs, result.buildMs);
+		fprintf(file, "      \"runs\": [\n");
+
+		for (size_t k = 0; k < result.runs.size(); ++k)
+		{
+			const BenchRun &run = result.runs[k];
+
+			fprintf(file, "        { \"threads\": %d, \"ms_per_frame\": %.3f, \"phases_ms\": { \"tiles\": %.3f, \"tonemap\": %.3f }, "
+				"\"camera_rays\": %llu, \"rays\": %llu, \"rays_per_sec\": %.0f, \"speedup\": %.3f }%s\n",
+				run.threads, run.frameMs, run.phases.tilesMs, run.phases.tonemapMs,
+				(unsigned long long)run.cameraRays, (unsigned long long)run.rays, run.rays / (run.frameMs / 1000.0),
+				result.runs[0].frameMs / run.frameMs, k + 1 < result.runs.size() ? "," : "");
+		}
+
+		fprintf(file, "      ]\n");
+		fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+	}
+
+	fprintf(file, "  ]\n}\n");
+
+	return fclose(file) == 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	BenchOptions options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	std::vector<BenchResult> results;
+
+	for (const BenchScence &bench : benchScences)
+	{
+		if (options.filter != nullptr && strstr(bench.name, options.filter) == nullptr) continue;
+
+		results.push_back(runScence(bench, options));
+	}
+
+	if (!writeJson(options.output, options, results))
+	{
+		fprintf(stderr, "can not write %s\n", options.output);
+		return 1;
+	}
+
+	return 0;
+}
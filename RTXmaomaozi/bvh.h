@@ -0,0 +1,971 @@
+#pragma once
+
+#include "aabb.h"
+#include "vec.h"
+#include "rayPacket.h"
+#include "renderStats.h"
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#define BVH_BIN_COUNT 12
+#define BVH_MAX_LEAF_SIZE 4
+#define BVH_MAX_DEPTH 48
+#define BVH_STACK_SIZE 64
+// update() builds a subtree again once its SAH cost grew past this times its cost when built
+#define BVH_REBUILD_RATIO 1.5f
+
+
+// 32 bytes per node, the two children of a node always share one cache line
+struct alignas(32) BvhNode
+{
+	float boundMin[3];
+	uint32_t leftFirst;		// inner node: index of left child (right child is leftFirst + 1), leaf: first primitive
+	float boundMax[3];
+	uint32_t count;			// primitive count of leaf, 0 for inner node
+
+	bool isLeaf() const
+	{
+		return count != 0;
+	}
+};
+
+
+struct BvhRay
+{
+	BvhRay(const Point3 &point, const Vec3 &direct)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			// avoid inf * 0 = nan while ray is parallel to a slab
+			float d = fabsf(direct[i]) > 1e-20f ? direct[i] : (direct[i] < 0 ? -1e-20f : 1e-20f);
+
+			origin[i] = point[i];
+			invDirect[i] = 1.0f / d;
+		}
+	}
+
+	float origin[3];
+	float invDirect[3];
+};
+
+
+class Bvh
+{
+public:
+	Bvh();
+	~Bvh();
+
+	Bvh(const Bvh &) = delete;
+	Bvh &operator=(const Bvh &) = delete;
+
+	// Build with binned SAH, primitive i is bounded by bounds[i]
+	void build(const std::vector<AABB> &bounds);
+
+	void clear();
+
+	// Bring the tree up to date with bounds, indexed like build(), without a full build.
+	// Primitives in removed leave the tree, primitives in added go into the leaf whose bound grows least,
+	// then bounds are refit bottom up in parallel and every subtree whose SAH cost grew past rebuildRatio
+	// times its cost when built is built again. Leaf ranges and primitive order may change
+	// Return number of subtrees built again
+	int update(const std::vector<AABB> &bounds, const std::vector<uint32_t> &added, const std::vector<uint32_t> &removed, float rebuildRatio);
+
+	// Sort primitives of every leaf by compare(primitiveA, primitiveB), traversal results are unchanged
+	template <typename Compare>
+	void sortLeaves(Compare compare);
+
+	// Leaf primitive ranges index into this order: slot k holds original primitive getPrimitiveOrder()[k]
+	const std::vector<uint32_t> &getPrimitiveOrder() const;
+
+	uint32_t getNodeCount() const;
+
+	// Node 0 is the root, nodes left behind by update() are not reachable from it
+	const BvhNode &getNode(uint32_t nodeIdx) const;
+
+	// Bytes of nodes and primitive order
+	size_t getMemoryBytes() const;
+
+	// visitLeaf(first, count, tMax) is called for every leaf the ray reaches within tMax, nearer child first.
+	// It may shrink tMax to cull farther nodes and returns true to stop the traversal
+	template <typename LeafFunc>
+	void traverse(const Point3 &point, const Vec3 &direct, float &tMax, LeafFunc visitLeaf) const;
+
+	// Shared traversal for a coherent packet, visitLeaf(first, count, laneMask, tMax) is called with the
+	// lanes reaching that leaf. tMax is 16 byte aligned, a negative tMax disables the lane
+	template <typename LeafFunc>
+	void traversePacket(const RayPacket &packet, float *tMax, LeafFunc visitLeaf) const;
+
+	// visitLeaf(first, count) is called once for every leaf
+	template <typename LeafFunc>
+	void forEachLeaf(LeafFunc visitLeaf) const;
+
+	static float intersectNode(const BvhNode &node, const BvhRay &ray, float tMax);
+
+	// Test one node against all lanes, return bit mask of the lanes hitting it
+	static int intersectNodePacket(const BvhNode &node, const RayPacket &packet, __m128 tMax);
+
+private:
+	struct BuildPrimitive
+	{
+		float boundMin[3];
+		float boundMax[3];
+		float centroid[3];
+	};
+
+	struct Bin
+	{
+		float boundMin[3];
+		float boundMax[3];
+		uint32_t count;
+	};
+
+	void setBuildPrimitives(const std::vector<AABB> &bounds);
+	void buildNodes();
+	void reserveNodes(uint32_t extra);
+	void compactNodes();
+	uint32_t copySubtree(BvhNode *target, std::vector<float> &targetCost, uint32_t nodeIdx, uint32_t targetIdx, uint32_t nextFree) const;
+
+	void updateNodeBounds(BvhNode &node);
+	void subdivide(uint32_t nodeIdx, int depth);
+	float findBestSplit(const BvhNode &node, int &axis, float &splitPos) const;
+
+	uint32_t findInsertLeaf(const BuildPrimitive &prim) const;
+	bool relayout(uint32_t nodeIdx, const std::vector<uint8_t> &isRemoved, const std::vector<std::pair<uint32_t, uint32_t>> &insertions, std::vector<uint32_t> &newPrimitives);
+	void refit();
+	void collectRefitRoots(uint32_t nodeIdx, int depth, int rootDepth, std::vector<uint32_t> &roots) const;
+	float refitTop(uint32_t nodeIdx, int depth, int rootDepth);
+	float refitNode(uint32_t nodeIdx);
+	void unionChildBounds(BvhNode &node) const;
+	int rebuildDegraded(uint32_t nodeIdx, int depth, float rebuildRatio);
+	void primitiveRange(uint32_t nodeIdx, uint32_t &first, uint32_t &count) const;
+	float subtreeCost(uint32_t nodeIdx);
+
+	static float surfaceArea(const float boundMin[3], const float boundMax[3]);
+
+private:
+	BvhNode *nodes = nullptr;
+	uint32_t nodeCount = 0;
+	uint32_t nodeCapacity = 0;
+
+	std::vector<uint32_t> primitives;
+	std::vector<BuildPrimitive> buildPrimitives;	// kept after build for update()
+
+	std::vector<float> nodeCost;		// SAH cost of the subtree of every node, up to date after refit
+	std::vector<float> builtCost;		// same when the subtree was built
+};
+
+
+inline Bvh::Bvh()
+{
+}
+
+
+inline Bvh::~Bvh()
+{
+	clear();
+}
+
+
+inline void Bvh::clear()
+{
+	if (nodes != nullptr) _mm_free(nodes);
+
+	nodes = nullptr;
+	nodeCount = 0;
+	nodeCapacity = 0;
+	primitives.clear();
+	buildPrimitives.clear();
+	nodeCost.clear();
+	builtCost.clear();
+}
+
+
+inline void Bvh::build(const std::vector<AABB> &bounds)
+{
+	clear();
+
+	uint32_t primitiveCount = (uint32_t)bounds.size();
+	if (primitiveCount == 0) return;
+
+	setBuildPrimitives(bounds);
+	primitives.resize(primitiveCount);
+
+	for (uint32_t i = 0; i < primitiveCount; ++i)
+	{
+		primitives[i] = i;
+	}
+
+	buildNodes();
+}
+
+
+inline void Bvh::setBuildPrimitives(const std::vector<AABB> &bounds)
+{
+	int primitiveCount = (int)bounds.size();
+	buildPrimitives.resize(primitiveCount);
+
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < primitiveCount; ++i)
+	{
+		BuildPrimitive &prim = buildPrimitives[i];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			prim.boundMin[axis] = bounds[i].get_top_left()[axis];
+			prim.boundMax[axis] = bounds[i].get_down_right()[axis];
+			prim.centroid[axis] = (prim.boundMin[axis] + prim.boundMax[axis]) * 0.5f;
+		}
+	}
+}
+
+
+// Build the whole tree over primitives
+inline void Bvh::buildNodes()
+{
+	if (nodes != nullptr) _mm_free(nodes);
+
+	uint32_t primitiveCount = (uint32_t)primitives.size();
+
+	// at most 2n - 1 nodes, slot 1 is left unused so every sibling pair starts on a 64 byte boundary
+	nodeCapacity = 2 * primitiveCount + 1;
+	nodes = (BvhNode *)_mm_malloc(sizeof(BvhNode) * nodeCapacity, 64);
+
+	BvhNode &root = nodes[0];
+	root.leftFirst = 0;
+	root.count = primitiveCount;
+	nodeCount = 2;
+
+	updateNodeBounds(root);
+	subdivide(0, 0);
+
+	nodeCost.resize(nodeCapacity);
+	builtCost.resize(nodeCapacity);
+
+	subtreeCost(0);
+	std::copy(nodeCost.begin(), nodeCost.begin() + nodeCount, builtCost.begin());
+}
+
+
+inline int Bvh::update(const std::vector<AABB> &bounds, const std::vector<uint32_t> &added, const std::vector<uint32_t> &removed, float rebuildRatio)
+{
+	setBuildPrimitives(bounds);
+
+	if (nodeCount == 0)
+	{
+		primitives = added;
+		if (!primitives.empty()) buildNodes();
+
+		return primitives.empty() ? 0 : 1;
+	}
+
+	// nodes left behind by earlier rebuilds are dropped once they are half of the array
+	if (nodeCount > 2 * (2 * (uint32_t)primitives.size() + 1)) compactNodes();
+
+	if (!added.empty() || !removed.empty())
+	{
+		std::vector<uint8_t> isRemoved(bounds.size(), 0);
+
+		for (uint32_t prim : removed)
+		{
+			isRemoved[prim] = 1;
+		}
+
+		// (leaf, primitive) sorted by leaf, bounds of nodes are those before refit
+		std::vector<std::pair<uint32_t, uint32_t>> insertions;
+		insertions.reserve(added.size());
+
+		for (uint32_t prim : added)
+		{
+			insertions.push_back(std::make_pair(findInsertLeaf(buildPrimitives[prim]), prim));
+		}
+
+		std::sort(insertions.begin(), insertions.end());
+
+		std::vector<uint32_t> newPrimitives;
+		newPrimitives.reserve(primitives.size() + added.size());
+
+		if (!relayout(0, isRemoved, insertions, newPrimitives))
+		{
+			clear();
+			return 0;
+		}
+
+		primitives.swap(newPrimitives);
+	}
+
+	refit();
+
+	return rebuildDegraded(0, 0, rebuildRatio);
+}
+
+
+template <typename Compare>
+inline void Bvh::sortLeaves(Compare compare)
+{
+	forEachLeaf([&](uint32_t first, uint32_t count)
+	{
+		std::stable_sort(primitives.begin() + first, primitives.begin() + first + count, compare);
+	});
+}
+
+
+// Room for extra more nodes after nodeCount, node indices stay valid
+inline void Bvh::reserveNodes(uint32_t extra)
+{
+	if (nodeCount + extra <= nodeCapacity) return;
+
+	uint32_t capacity = max(nodeCount + extra, nodeCapacity + nodeCapacity / 2);
+	BvhNode *grown = (BvhNode *)_mm_malloc(sizeof(BvhNode) * capacity, 64);
+
+	memcpy(grown, nodes, sizeof(BvhNode) * nodeCount);
+	_mm_free(nodes);
+
+	nodes = grown;
+	nodeCapacity = capacity;
+	nodeCost.resize(capacity);
+	builtCost.resize(capacity);
+}
+
+
+// Copy reachable nodes to a new array in depth first order
+inline void Bvh::compactNodes()
+{
+	uint32_t capacity = 2 * (uint32_t)primitives.size() + 1;
+	BvhNode *compacted = (BvhNode *)_mm_malloc(sizeof(BvhNode) * capacity, 64);
+	std::vector<float> compactedCost(capacity);
+
+	compacted[0] = nodes[0];
+	compactedCost[0] = builtCost[0];
+	nodeCount = copySubtree(compacted, compactedCost, 0, 0, 2);
+
+	_mm_free(nodes);
+
+	nodes = compacted;
+	nodeCapacity = capacity;
+	builtCost.swap(compactedCost);
+	nodeCost.resize(capacity);
+}
+
+
+// Children of nodeIdx go to target from nextFree on, return next free index after the subtree
+inline uint32_t Bvh::copySubtree(BvhNode *target, std::vector<float> &targetCost, uint32_t nodeIdx, uint32_t targetIdx, uint32_t nextFree) const
+{
+	const BvhNode &node = nodes[nodeIdx];
+
+	if (node.isLeaf()) return nextFree;
+
+	uint32_t leftIdx = nextFree;
+
+	target[leftIdx] = nodes[node.leftFirst];
+	target[leftIdx + 1] = nodes[node.leftFirst + 1];
+	targetCost[leftIdx] = builtCost[node.leftFirst];
+	targetCost[leftIdx + 1] = builtCost[node.leftFirst + 1];
+	target[targetIdx].leftFirst = leftIdx;
+
+	nextFree = copySubtree(target, targetCost, node.leftFirst, leftIdx, nextFree + 2);
+	return copySubtree(target, targetCost, node.leftFirst + 1, leftIdx + 1, nextFree);
+}
+
+
+inline const std::vector<uint32_t> &Bvh::getPrimitiveOrder() const
+{
+	return primitives;
+}
+
+
+inline uint32_t Bvh::getNodeCount() const
+{
+	return nodeCount;
+}
+
+
+inline const BvhNode &Bvh::getNode(uint32_t nodeIdx) const
+{
+	return nodes[nodeIdx];
+}
+
+
+inline size_t Bvh::getMemoryBytes() const
+{
+	return sizeof(BvhNode) * nodeCapacity + primitives.capacity() * sizeof(uint32_t) + buildPrimitives.capacity() * sizeof(BuildPrimitive) +
+		(nodeCost.capacity() + builtCost.capacity()) * sizeof(float);
+}
+
+
+inline void Bvh::updateNodeBounds(BvhNode &node)
+{
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		node.boundMin[axis] = FLT_MAX;
+		node.boundMax[axis] = -FLT_MAX;
+	}
+
+	for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+	{
+		const BuildPrimitive &prim = buildPrimitives[primitives[i]];
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node.boundMin[axis] = min(node.boundMin[axis], prim.boundMin[axis]);
+			node.boundMax[axis] = max(node.boundMax[axis], prim.boundMax[axis]);
+		}
+	}
+}
+
+
+inline float Bvh::surfaceArea(const float boundMin[3], const float boundMax[3])
+{
+	float ex = boundMax[0] - boundMin[0];
+	float ey = boundMax[1] - boundMin[1];
+	float ez = boundMax[2] - boundMin[2];
+
+	return ex * ey + ey * ez + ez * ex;
+}
+
+
+inline float Bvh::findBestSplit(const BvhNode &node, int &axis, float &splitPos) const
+{
+	float bestCost = FLT_MAX;
+
+	for (int a = 0; a < 3; ++a)
+	{
+		float centroidMin = FLT_MAX;
+		float centroidMax = -FLT_MAX;
+
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			float c = buildPrimitives[primitives[i]].centroid[a];
+			centroidMin = min(centroidMin, c);
+			centroidMax = max(centroidMax, c);
+		}
+
+		if (centroidMin == centroidMax) continue;
+
+		Bin bins[BVH_BIN_COUNT];
+		for (int b = 0; b < BVH_BIN_COUNT; ++b)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				bins[b].boundMin[k] = FLT_MAX;
+				bins[b].boundMax[k] = -FLT_MAX;
+			}
+			bins[b].count = 0;
+		}
+
+		float scale = BVH_BIN_COUNT / (centroidMax - centroidMin);
+
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			const BuildPrimitive &prim = buildPrimitives[primitives[i]];
+			int b = min(BVH_BIN_COUNT - 1, (int)((prim.centroid[a] - centroidMin) * scale));
+
+			for (int k = 0; k < 3; ++k)
+			{
+				bins[b].boundMin[k] = min(bins[b].boundMin[k], prim.boundMin[k]);
+				bins[b].boundMax[k] = max(bins[b].boundMax[k], prim.boundMax[k]);
+			}
+			bins[b].count++;
+		}
+
+		// sweep from both side, plane i lies between bin i and bin i + 1
+		float leftArea[BVH_BIN_COUNT - 1], rightArea[BVH_BIN_COUNT - 1];
+		uint32_t leftCount[BVH_BIN_COUNT - 1], rightCount[BVH_BIN_COUNT - 1];
+
+		float leftMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, leftMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		float rightMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, rightMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		uint32_t leftSum = 0, rightSum = 0;
+
+		for (int i = 0; i < BVH_BIN_COUNT - 1; ++i)
+		{
+			const Bin &lb = bins[i];
+			const Bin &rb = bins[BVH_BIN_COUNT - 1 - i];
+
+			for (int k = 0; k < 3; ++k)
+			{
+				leftMin[k] = min(leftMin[k], lb.boundMin[k]);
+				leftMax[k] = max(leftMax[k], lb.boundMax[k]);
+				rightMin[k] = min(rightMin[k], rb.boundMin[k]);
+				rightMax[k] = max(rightMax[k], rb.boundMax[k]);
+			}
+
+			leftSum += lb.count;
+			rightSum += rb.count;
+
+			leftCount[i] = leftSum;
+			leftArea[i] = leftSum ? surfaceArea(leftMin, leftMax) : 0.0f;
+			rightCount[BVH_BIN_COUNT - 2 - i] = rightSum;
+			rightArea[BVH_BIN_COUNT - 2 - i] = rightSum ? surfaceArea(rightMin, rightMax) : 0.0f;
+		}
+
+		for (int i = 0; i < BVH_BIN_COUNT - 1; ++i)
+		{
+			if (leftCount[i] == 0 || rightCount[i] == 0) continue;
+
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				axis = a;
+				splitPos = centroidMin + (i + 1) / scale;
+			}
+		}
+	}
+
+	return bestCost;
+}
+
+
+inline void Bvh::subdivide(uint32_t nodeIdx, int depth)
+{
+	BvhNode &node = nodes[nodeIdx];
+
+	if (node.count <= 1 || depth >= BVH_MAX_DEPTH) return;
+
+	int axis = 0;
+	float splitPos = 0.0f;
+	float splitCost = findBestSplit(node, axis, splitPos);
+
+	// keep small leaf if splitting will not reduce the expected intersection cost
+	float leafCost = node.count * surfaceArea(node.boundMin, node.boundMax);
+	if (splitCost == FLT_MAX || (node.count <= BVH_MAX_LEAF_SIZE && splitCost >= leafCost)) return;
+
+	// in place partition by centroid
+	uint32_t i = node.leftFirst;
+	uint32_t j = node.leftFirst + node.count;
+
+	while (i < j)
+	{
+		if (buildPrimitives[primitives[i]].centroid[axis] < splitPos)
+		{
+			++i;
+		}
+		else
+		{
+			std::swap(primitives[i], primitives[--j]);
+		}
+	}
+
+	uint32_t leftCount = i - node.leftFirst;
+	if (leftCount == 0 || leftCount == node.count) return;
+
+	uint32_t leftIdx = nodeCount;
+	nodeCount += 2;
+
+	BvhNode &leftChild = nodes[leftIdx];
+	BvhNode &rightChild = nodes[leftIdx + 1];
+
+	leftChild.leftFirst = node.leftFirst;
+	leftChild.count = leftCount;
+	rightChild.leftFirst = i;
+	rightChild.count = node.count - leftCount;
+
+	node.leftFirst = leftIdx;
+	node.count = 0;
+
+	updateNodeBounds(leftChild);
+	updateNodeBounds(rightChild);
+
+	subdivide(leftIdx, depth + 1);
+	subdivide(leftIdx + 1, depth + 1);
+}
+
+
+// Leaf whose bound grows least in surface area by prim, descending from the root
+inline uint32_t Bvh::findInsertLeaf(const BuildPrimitive &prim) const
+{
+	uint32_t nodeIdx = 0;
+
+	while (!nodes[nodeIdx].isLeaf())
+	{
+		uint32_t bestChild = nodes[nodeIdx].leftFirst;
+		float bestGrowth = FLT_MAX;
+
+		for (uint32_t child = nodes[nodeIdx].leftFirst; child <= nodes[nodeIdx].leftFirst + 1; ++child)
+		{
+			const BvhNode &node = nodes[child];
+			float grownMin[3], grownMax[3];
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				grownMin[axis] = min(node.boundMin[axis], prim.boundMin[axis]);
+				grownMax[axis] = max(node.boundMax[axis], prim.boundMax[axis]);
+			}
+
+			float growth = surfaceArea(grownMin, grownMax) - surfaceArea(node.boundMin, node.boundMax);
+
+			if (growth < bestGrowth)
+			{
+				bestGrowth = growth;
+				bestChild = child;
+			}
+		}
+
+		nodeIdx = bestChild;
+	}
+
+	return nodeIdx;
+}
+
+
+// Write primitives of every leaf below nodeIdx to newPrimitives in leaf order, without removed and with insertions
+// An inner node left with one non empty child takes its place, return false if nothing is left below nodeIdx
+inline bool Bvh::relayout(uint32_t nodeIdx, const std::vector<uint8_t> &isRemoved, const std::vector<std::pair<uint32_t, uint32_t>> &insertions, std::vector<uint32_t> &newPrimitives)
+{
+	BvhNode &node = nodes[nodeIdx];
+
+	if (node.isLeaf())
+	{
+		uint32_t first = (uint32_t)newPrimitives.size();
+
+		for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+		{
+			if (!isRemoved[primitives[i]]) newPrimitives.push_back(primitives[i]);
+		}
+
+		auto inserted = std::equal_range(insertions.begin(), insertions.end(), std::make_pair(nodeIdx, 0u), [](const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b)
+		{
+			return a.first < b.first;
+		});
+
+		for (auto it = inserted.first; it != inserted.second; ++it)
+		{
+			newPrimitives.push_back(it->second);
+		}
+
+		node.leftFirst = first;
+		node.count = (uint32_t)newPrimitives.size() - first;
+
+		return node.count != 0;
+	}
+
+	uint32_t leftIdx = node.leftFirst;
+	bool hasLeft = relayout(leftIdx, isRemoved, insertions, newPrimitives);
+	bool hasRight = relayout(leftIdx + 1, isRemoved, insertions, newPrimitives);
+
+	if (hasLeft && hasRight) return true;
+	if (!hasLeft && !hasRight) return false;
+
+	uint32_t kept = hasLeft ? leftIdx : leftIdx + 1;
+	nodes[nodeIdx] = nodes[kept];
+	builtCost[nodeIdx] = builtCost[kept];
+
+	return true;
+}
+
+
+// Subtrees at rootDepth are refit on all threads, then the few nodes above them
+inline void Bvh::refit()
+{
+#ifdef _OPENMP
+	int threads = omp_get_max_threads();
+#else
+	int threads = 1;
+#endif
+
+	int rootDepth = 0;
+
+	while ((1 << rootDepth) < threads * 4 && rootDepth < 16)
+	{
+		++rootDepth;
+	}
+
+	std::vector<uint32_t> roots;
+	collectRefitRoots(0, 0, rootDepth, roots);
+
+	int rootCount = (int)roots.size();
+
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < rootCount; ++i)
+	{
+		refitNode(roots[i]);
+	}
+
+	refitTop(0, 0, rootDepth);
+}
+
+
+inline void Bvh::collectRefitRoots(uint32_t nodeIdx, int depth, int rootDepth, std::vector<uint32_t> &roots) const
+{
+	const BvhNode &node = nodes[nodeIdx];
+
+	if (depth == rootDepth || node.isLeaf())
+	{
+		roots.push_back(nodeIdx);
+		return;
+	}
+
+	collectRefitRoots(node.leftFirst, depth + 1, rootDepth, roots);
+	collectRefitRoots(node.leftFirst + 1, depth + 1, rootDepth, roots);
+}
+
+
+// Nodes above rootDepth, the subtrees collected by collectRefitRoots() are already refit
+inline float Bvh::refitTop(uint32_t nodeIdx, int depth, int rootDepth)
+{
+	BvhNode &node = nodes[nodeIdx];
+
+	if (depth == rootDepth || node.isLeaf()) return nodeCost[nodeIdx];
+
+	float childCost = refitTop(node.leftFirst, depth + 1, rootDepth) + refitTop(node.leftFirst + 1, depth + 1, rootDepth);
+	unionChildBounds(node);
+
+	nodeCost[nodeIdx] = surfaceArea(node.boundMin, node.boundMax) + childCost;
+	return nodeCost[nodeIdx];
+}
+
+
+// Refit bounds of the subtree bottom up, return its SAH cost
+inline float Bvh::refitNode(uint32_t nodeIdx)
+{
+	BvhNode &node = nodes[nodeIdx];
+
+	if (node.isLeaf())
+	{
+		updateNodeBounds(node);
+		nodeCost[nodeIdx] = surfaceArea(node.boundMin, node.boundMax) * node.count;
+		return nodeCost[nodeIdx];
+	}
+
+	float childCost = refitNode(node.leftFirst) + refitNode(node.leftFirst + 1);
+	unionChildBounds(node);
+
+	nodeCost[nodeIdx] = surfaceArea(node.boundMin, node.boundMax) + childCost;
+	return nodeCost[nodeIdx];
+}
+
+
+inline void Bvh::unionChildBounds(BvhNode &node) const
+{
+	const BvhNode &left = nodes[node.leftFirst];
+	const BvhNode &right = nodes[node.leftFirst + 1];
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		node.boundMin[axis] = min(left.boundMin[axis], right.boundMin[axis]);
+		node.boundMax[axis] = max(left.boundMax[axis], right.boundMax[axis]);
+	}
+}
+
+
+// Build again the highest subtrees whose cost degraded, their old nodes are left unreachable
+inline int Bvh::rebuildDegraded(uint32_t nodeIdx, int depth, float rebuildRatio)
+{
+	if (nodeCost[nodeIdx] > rebuildRatio * builtCost[nodeIdx])
+	{
+		uint32_t first, count;
+		primitiveRange(nodeIdx, first, count);
+
+		reserveNodes(2 * count);
+
+		uint32_t oldNodeCount = nodeCount;
+		BvhNode &node = nodes[nodeIdx];
+
+		node.leftFirst = first;
+		node.count = count;
+		subdivide(nodeIdx, depth);
+
+		subtreeCost(nodeIdx);
+		builtCost[nodeIdx] = nodeCost[nodeIdx];
+		std::copy(nodeCost.begin() + oldNodeCount, nodeCost.begin() + nodeCount, builtCost.begin() + oldNodeCount);
+
+		return 1;
+	}
+
+	if (nodes[nodeIdx].isLeaf()) return 0;
+
+	uint32_t leftIdx = nodes[nodeIdx].leftFirst;
+
+	return rebuildDegraded(leftIdx, depth + 1, rebuildRatio) + rebuildDegraded(leftIdx + 1, depth + 1, rebuildRatio);
+}
+
+
+// Leaves of a subtree cover one contiguous range of primitives
+inline void Bvh::primitiveRange(uint32_t nodeIdx, uint32_t &first, uint32_t &count) const
+{
+	uint32_t leftmost = nodeIdx;
+	uint32_t rightmost = nodeIdx;
+
+	while (!nodes[leftmost].isLeaf()) leftmost = nodes[leftmost].leftFirst;
+	while (!nodes[rightmost].isLeaf()) rightmost = nodes[rightmost].leftFirst + 1;
+
+	first = nodes[leftmost].leftFirst;
+	count = nodes[rightmost].leftFirst + nodes[rightmost].count - first;
+}
+
+
+// SAH cost of subtree with current bounds, an inner node costs its area and a leaf its area per primitive
+inline float Bvh::subtreeCost(uint32_t nodeIdx)
+{
+	const BvhNode &node = nodes[nodeIdx];
+	float area = surfaceArea(node.boundMin, node.boundMax);
+
+	nodeCost[nodeIdx] = node.isLeaf() ? area * node.count : area + subtreeCost(node.leftFirst) + subtreeCost(node.leftFirst + 1);
+	return nodeCost[nodeIdx];
+}
+
+
+// Return the entry distance of ray, FLT_MAX for no intersection within [0, tMax)
+inline float Bvh::intersectNode(const BvhNode &node, const BvhRay &ray, float tMax)
+{
+	float tNear = 0.0f;
+	float tFar = tMax;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		float t1 = (node.boundMin[axis] - ray.origin[axis]) * ray.invDirect[axis];
+		float t2 = (node.boundMax[axis] - ray.origin[axis]) * ray.invDirect[axis];
+
+		if (t1 > t2) std::swap(t1, t2);
+		if (t1 > tNear) tNear = t1;
+		if (t2 < tFar) tFar = t2;
+	}
+
+	return tNear <= tFar ? tNear : FLT_MAX;
+}
+
+
+template <typename LeafFunc>
+inline void Bvh::traverse(const Point3 &point, const Vec3 &direct, float &tMax, LeafFunc visitLeaf) const
+{
+	if (nodeCount == 0) return;
+
+	BvhRay ray(point, direct);
+
+	// node with its entry distance, checked again when popped since tMax may have shrunk
+	struct StackEntry
+	{
+		uint32_t node;
+		float tNear;
+	};
+
+	StackEntry stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	float rootNear = intersectNode(nodes[0], ray, tMax);
+	if (rootNear == FLT_MAX) return;
+
+	stack[stackSize++] = { 0, rootNear };
+
+	while (stackSize > 0)
+	{
+		StackEntry entry = stack[--stackSize];
+
+		if (entry.tNear > tMax) continue;
+
+		RENDER_STAT_ADD(nodeVisits, 1);
+
+		const BvhNode &node = nodes[entry.node];
+
+		if (node.isLeaf())
+		{
+			if (visitLeaf(node.leftFirst, node.count, tMax)) return;
+			continue;
+		}
+
+		uint32_t nearChild = node.leftFirst;
+		uint32_t farChild = node.leftFirst + 1;
+
+		float tNearChild = intersectNode(nodes[nearChild], ray, tMax);
+		float tFarChild = intersectNode(nodes[farChild], ray, tMax);
+
+		if (tFarChild < tNearChild)
+		{
+			std::swap(nearChild, farChild);
+			std::swap(tNearChild, tFarChild);
+		}
+
+		// far child goes below near child, so it is visited after the near one shrank tMax
+		if (tFarChild != FLT_MAX) stack[stackSize++] = { farChild, tFarChild };
+		if (tNearChild != FLT_MAX) stack[stackSize++] = { nearChild, tNearChild };
+	}
+}
+
+
+template <typename LeafFunc>
+inline void Bvh::forEachLeaf(LeafFunc visitLeaf) const
+{
+	if (nodeCount == 0) return;
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BvhNode &node = nodes[stack[--stackSize]];
+
+		if (node.isLeaf())
+		{
+			visitLeaf(node.leftFirst, node.count);
+			continue;
+		}
+
+		stack[stackSize++] = node.leftFirst + 1;
+		stack[stackSize++] = node.leftFirst;
+	}
+}
+
+
+inline int Bvh::intersectNodePacket(const BvhNode &node, const RayPacket &packet, __m128 tMax)
+{
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin[0]), _mm_load_ps(packet.originX)), _mm_load_ps(packet.invDirectX));
+	__m128 t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax[0]), _mm_load_ps(packet.originX)), _mm_load_ps(packet.invDirectX));
+	__m128 tNear = _mm_max_ps(_mm_min_ps(t1, t2), _mm_setzero_ps());
+	__m128 tFar = _mm_min_ps(_mm_max_ps(t1, t2), tMax);
+
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin[1]), _mm_load_ps(packet.originY)), _mm_load_ps(packet.invDirectY));
+	t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax[1]), _mm_load_ps(packet.originY)), _mm_load_ps(packet.invDirectY));
+	tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+	tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+	t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMin[2]), _mm_load_ps(packet.originZ)), _mm_load_ps(packet.invDirectZ));
+	t2 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.boundMax[2]), _mm_load_ps(packet.originZ)), _mm_load_ps(packet.invDirectZ));
+	tNear = _mm_max_ps(tNear, _mm_min_ps(t1, t2));
+	tFar = _mm_min_ps(tFar, _mm_max_ps(t1, t2));
+
+	return _mm_movemask_ps(_mm_cmple_ps(tNear, tFar));
+}
+
+
+template <typename LeafFunc>
+inline void Bvh::traversePacket(const RayPacket &packet, float *tMax, LeafFunc visitLeaf) const
+{
+	if (nodeCount == 0) return;
+
+	uint32_t stack[BVH_STACK_SIZE];
+	int stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const BvhNode &node = nodes[stack[--stackSize]];
+
+		// node is visited once for the whole packet if any lane reaches it
+		int mask = intersectNodePacket(node, packet, _mm_load_ps(tMax));
+		if (mask == 0) continue;
+
+#ifdef USE_RENDER_STATS
+		for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+		{
+			if (mask & (1 << lane)) RENDER_STAT_ADD(nodeVisits, 1);
+		}
+#endif
+
+		if (node.isLeaf())
+		{
+			visitLeaf(node.leftFirst, node.count, mask, tMax);
+			continue;
+		}
+
+		stack[stackSize++] = node.leftFirst + 1;
+		stack[stackSize++] = node.leftFirst;
+	}
+}
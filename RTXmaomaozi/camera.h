@@ -31,6 +31,7 @@ public:
 	// (right-clockwise) for positive angel
 	void turnByX(float angel)
 	{
+		++version;
 		turnVecByVec(_verticalVec, _horizonVec, angel);
 
 		screenCenter = cameraPosition + _verticalVec * (height / 2) + _horizonVec * (width / 2);
@@ -44,7 +45,7 @@ public:
 	// top-clockwise for positive angel
 	void turnByY(float angel)
 	{
-
+		++version;
 		turnVecByVec(_horizonVec, _verticalVec, angel);
 
 		screenCenter = cameraPosition + _verticalVec * (height / 2) + _horizonVec * (width / 2);
@@ -57,6 +58,7 @@ public:
 
 
 	void moveX(float offset) {
+		++version;
 		cameraPosition.x += offset;
 		screenCenter.x += offset;
 		viewPoint.x += offset;
@@ -64,6 +66,7 @@ public:
 
 
 	void moveY(float offset) {
+		++version;
 		cameraPosition.y += offset;
 		screenCenter.y += offset;
 		viewPoint.y += offset;
@@ -71,6 +74,7 @@ public:
 
 
 	void moveZ(float offset) {
+		++version;
 		cameraPosition.z += offset;
 		screenCenter.z += offset;
 		viewPoint.z += offset;
@@ -78,6 +82,7 @@ public:
 
 	void setPosition(const Point3 &newPosition)
 	{
+		++version;
 		cameraPosition = newPosition;
 		screenCenter = cameraPosition + _verticalVec * (height / 2) + _horizonVec * (width / 2);
 
@@ -105,6 +110,26 @@ public:
 		return viewRay;
 	}
 
+	// Pixel coordinates whose view ray passes point, inverse of getViewRay()
+	// Return false if point is not in front of view point
+	bool project(const Point3 &point, float &x, float &y) const
+	{
+		Vec3 norm = _verticalVec.xmul(_horizonVec);
+		Vec3 toPoint = point - viewPoint;
+
+		float pointAlong = toPoint * norm;
+		float screenAlong = (cameraPosition - viewPoint) * norm;
+
+		if (pointAlong * screenAlong <= 0) return false;
+
+		Vec3 offset = viewPoint + toPoint * (screenAlong / pointAlong) - cameraPosition;
+
+		x = offset * _horizonVec;
+		y = offset * _verticalVec;
+
+		return true;
+	}
+
 	const Point3 &getViewPoint() const
 	{
 		return viewPoint;
@@ -120,6 +145,12 @@ public:
 		return height;
 	}
 
+	// Changed every time camera moves or turns
+	uint32_t getVersion() const
+	{
+		return version;
+	}
+
 private:
 	void turnVecByVec(Vec3 &vec1, const Vec3 &vec2, float angel)
 	{
@@ -138,4 +169,6 @@ private:
 	Point3 cameraPosition;
 	Point3 screenCenter;
 	Point3 viewPoint;
+
+	uint32_t version = 0;
 };
\ No newline at end of file
@@ -5,4 +5,6 @@
 #define SCR_BPP 32
 #define SCR_COLOR_R 0xff
 #define SCR_COLOR_G 0xff
-#define SCR_COLOR_B 0xff
\ No newline at end of file
+#define SCR_COLOR_B 0xff
+
+#define PROGRESSIVE_MAX_PASS 256
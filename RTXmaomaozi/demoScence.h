@@ -0,0 +1,156 @@
+#pragma once
+
+#include "scence.h"
+#include "camera.h"
+
+
+// Floor, walls, ceiling and lights of the demo scence
+inline void buildDemoRoom(Scence &scence)
+{
+	scence.addPlane(Plane(Vec3(0, 1, 0), Point3(0, 0, 0), Color(1, 1, 1), 1.0f));
+
+	scence.addTriangle(Triangle({ 2200, 2500, 1000 }, { 2200, 2500, 4000 }, { -4000, 2500, 4000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+	scence.addTriangle(Triangle({ 2200, 2500, 1000 }, { -3000, 2500, 4000 }, { -3000, 2500, -3000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+	scence.addTriangle(Triangle({ -4000, 2501, 4000 }, { 2200, 2501, 4000 }, { 2200, 2501, 1000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+	scence.addTriangle(Triangle({ -3000, 2501, -3000 }, { -3000, 2501, 4000 }, { 2200, 2501, 1000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+
+	scence.addPlane(Plane(Vec3(0, 0, -1), Point3(0, 0, 3000), Color(1, 1, 1), 1.0f));
+	scence.addPlane(Plane(Vec3(0, 0, 1), Point3(0, 0, -3000), Color(1, 1, 1), 1.0f));
+
+	scence.addPlane(Plane(Vec3(1, 0, 0), Point3(-2000, 0, 0), Color(1, 1, 1), 1.0f));
+
+
+	scence.addTriangle(Triangle({ 2200, 0, 1100 }, { 2200, 10000, 1100 }, { 2200, 0, -1000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+	scence.addTriangle(Triangle({ 2200, 0, 10000 }, { 2200, 10000, 1600 }, { 2200, 0, 1600 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+
+	scence.addTriangle(Triangle({ 2250, 0, -1000 }, { 2250, 10000, 1100 }, { 2250, 0, 1100 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+	scence.addTriangle(Triangle({ 2250, 0, 1600 }, { 2250, 10000, 1600 }, { 2250, 0, 10000 }, { 1, 1, 1 }, { 0.0f, 0.0f, 0.0f }, 1.4f, 1.0f));
+
+	scence.addLight(SphereSpotLight({ 500, 2000, 1000 }, { 255, 230, 202 }, 30.0f, { 0.0f, -1, 0.0f }, 0.01f, 300.0f));
+	scence.addLight(SphereDotLight({ 500, 2200, 1000 }, { 255, 230, 202 }, 20.0f, 80.0f));
+	scence.addLight(SphereSpotLight({ 5000, 3000, 1500 }, { 135,206,250 }, 30.0f, { -1.0f, -0.8f, 0.0f }, 0.01f, 350.0f));
+}
+
+
+// Demo room with glass and gold sphere, shared by the window and headless program
+inline void buildDemoScence(Scence &scence, bool withSphereGrid)
+{
+	buildDemoRoom(scence);
+
+	scence.addSphere(Sphere({ 500, 800, 1000 }, 400, { 0.01f, 0.01f, 0.01f }, { 0.99f, 0.99f, 0.98f }, 1.6f, 0.01f));
+	scence.addSphere(Sphere({ -200, 400, 1900 }, 400, { 0.99f, 0.94f, 0 }, { 0.00f, 0.00f, 0.00f }, 1.0f, 0.05f));
+
+	if (withSphereGrid)
+	{
+		for (int i = 0; i < 7; ++i) {
+			for (int j = 0; j < 4; ++j) {
+				for (int k = 0; k < 4; ++k) {
+					scence.addSphere(Sphere({ -800.0f + 400 * i, 200.0f + 300 * j, 300.0f + 300 * k }, 120, { 0.01f, 0.01f, 0.01f }, { 0.99f, 0.99f, 0.99f }, 1.5f, 0.01f));
+				}
+			}
+		}
+	}
+}
+
+
+// Grid of small lights under the ceiling, every other one a spot light facing down
+// Total power is about the demo room's dot light whatever the count is
+inline void addLightGrid(Scence &scence, int lightCount)
+{
+	if (lightCount <= 0) return;
+
+	int side = (int)ceilf(sqrtf((float)lightCount));
+	float strength = 20.0f * 4 / lightCount;
+
+	for (int i = 0; i < lightCount; ++i)
+	{
+		Point3 position(-1500.0f + 3500.0f * (i % side) / side, 2300.0f, -500.0f + 3300.0f * (i / side) / side);
+		Color color(200.0f + 55.0f * (i % 3) / 2, 230.0f, 255.0f - 55.0f * (i % 5) / 4);
+
+		if (i % 2 == 0)
+		{
+			scence.addLight(SphereDotLight(position, color, strength, 20.0f));
+		}
+		else
+		{
+			scence.addLight(SphereSpotLight(position, color, strength * 2, { 0.0f, -1, 0.0f }, 0.2f, 20.0f));
+		}
+	}
+}
+
+
+// Demo room with a bumpy sphere mesh of about triangleCount triangles in place of the glass sphere
+// Return the number of triangles added
+inline int buildMeshScence(Scence &scence, int triangleCount)
+{
+	buildDemoRoom(scence);
+
+	// latitude-longitude grid, slices = 2 * stacks and two triangles per cell
+	int stacks = max((int)sqrtf(triangleCount / 4.0f), 2);
+	int slices = stacks * 2;
+
+	Point3 center(500, 800, 1000);
+	const float pi = 3.14159265f;
+
+	IndexedMesh mesh;
+	mesh.vertices.reserve((stacks + 1) * (slices + 1) * 3);
+
+	for (int i = 0; i <= stacks; ++i)
+	{
+		float theta = pi * i / stacks;
+
+		for (int j = 0; j <= slices; ++j)
+		{
+			float phi = 2 * pi * j / slices;
+			float radius = 400.0f + 20.0f * sinf(theta * 12) * sinf(phi * 12);
+
+			Point3 vertex = center + Vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)) * radius;
+
+			mesh.vertices.push_back(vertex.x);
+			mesh.vertices.push_back(vertex.y);
+			mesh.vertices.push_back(vertex.z);
+		}
+	}
+
+	for (int i = 0; i < stacks; ++i)
+	{
+		for (int j = 0; j < slices; ++j)
+		{
+			uint32_t a = i * (slices + 1) + j;
+			uint32_t b = i * (slices + 1) + j + 1;
+			uint32_t c = (i + 1) * (slices + 1) + j;
+			uint32_t d = (i + 1) * (slices + 1) + j + 1;
+
+			// cells at the poles have one degenerate half
+			if (i != 0)
+			{
+				mesh.indices.insert(mesh.indices.end(), { a, b, c });
+			}
+
+			if (i != stacks - 1)
+			{
+				mesh.indices.insert(mesh.indices.end(), { b, d, c });
+			}
+		}
+	}
+
+	return (int)scence.addMesh(mesh, { 0.3f, 0.3f, 0.3f }, { 0.0f, 0.0f, 0.0f }, 1.0f, 0.2f);
+}
+
+
+// Demo room with a loaded mesh in place of the glass sphere, mesh is scaled to the size of the sphere
+// Return the number of triangles added
+inline size_t buildMeshScence(Scence &scence, IndexedMesh &mesh)
+{
+	buildDemoRoom(scence);
+
+	mesh.fit(Point3(500, 800, 1000), 800.0f);
+	return scence.addMesh(mesh, { 0.3f, 0.3f, 0.3f }, { 0.0f, 0.0f, 0.0f }, 1.0f, 0.2f);
+}
+
+
+// Demo camera, screen distance scales with width so every resolution see the same view
+inline Camera createDemoCamera(int width, int height)
+{
+	return Camera({ 0.0f, 800.0f, -1000 }, { -0.06f, 1.0f, 0.3f }, { 1.0f, 0.0f, 0.2f }, (float)width, (float)height, 800.0f * width / 1280);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vec.h"
+#include "object.h"
+#include "light.h"
+
+
+// Normal of every neighbour must be within this cosine of the pixel normal
+#define GBUFFER_NORMAL_COS 0.98f
+// Largest difference of inverse depth from the neighbour average, relative to the inverse depth of pixel
+#define GBUFFER_DEPTH_TOLERANCE 0.02f
+
+
+// First hit of the ray through pixel corner, no shading
+struct GBufferSample
+{
+	GBufferSample() : object(nullptr), light(nullptr), depth(0), normal(0, 0, 0)
+	{
+		;
+	}
+
+	const Object *object;			// nullptr for background
+	const VolumnLight *light;		// light source the ray passes before object, nullptr if none
+	float depth;
+	Vec3 normal;
+};
+
+
+// If pixel lies on the same surface as all of its neighbours, so their average can stand for it
+// Inverse depth is linear in screen space on a plane, so it is compared with the neighbour average
+inline bool isSameSurface(const GBufferSample &pixel, const GBufferSample *const *neighbours, int count)
+{
+	float inverseDepthSum = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		const GBufferSample &neighbour = *neighbours[i];
+
+		if (neighbour.object != pixel.object || neighbour.light != pixel.light) return false;
+
+		if (pixel.object == nullptr) continue;
+
+		if (neighbour.normal * pixel.normal < GBUFFER_NORMAL_COS) return false;
+
+		inverseDepthSum += 1.0f / neighbour.depth;
+	}
+
+	if (pixel.object == nullptr) return true;
+
+	float inverseDepth = 1.0f / pixel.depth;
+
+	return fabsf(inverseDepthSum / count - inverseDepth) <= GBUFFER_DEPTH_TOLERANCE * inverseDepth;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "color.h"
+#include <string.h>
+
+
+/*
+	Linear float RGB image written by Tracer, on the same scale as Color where 255 is displayed as white.
+	Channels are kept in separate planes, padded with zero so the tone mapping pass can load 4 pixels
+	of a channel at once from anywhere in a row. Row 0 is the bottom of image like bitmap.
+*/
+class HdrFrame
+{
+public:
+	HdrFrame() {}
+	~HdrFrame();
+
+	HdrFrame(const HdrFrame &) = delete;
+	HdrFrame &operator=(const HdrFrame &) = delete;
+
+	// Pixels are undefined after the size changes
+	void resize(int width, int height);
+
+	void set(int pixel, const Color &color)
+	{
+		planes[0][pixel] = color.r;
+		planes[1][pixel] = color.g;
+		planes[2][pixel] = color.b;
+	}
+
+	Color get(int pixel) const
+	{
+		return Color(planes[0][pixel], planes[1][pixel], planes[2][pixel]);
+	}
+
+	// channel 0 is red, 1 green and 2 blue
+	const float *getPlane(int channel) const
+	{
+		return planes[channel];
+	}
+
+	int getWidth() const
+	{
+		return width;
+	}
+
+	int getHeight() const
+	{
+		return height;
+	}
+
+	// Pixel count rounded up to multiple of 4, and one more block for the last block of the last row
+	int getPaddedSize() const
+	{
+		return ((width * height + 3) & ~3) + 4;
+	}
+
+private:
+	int width = 0;
+	int height = 0;
+	int capacity = 0;
+	float *planes[3] = { nullptr, nullptr, nullptr };
+};
+
+
+inline HdrFrame::~HdrFrame()
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		_mm_free(planes[i]);
+	}
+}
+
+
+inline void HdrFrame::resize(int width, int height)
+{
+	this->width = width;
+	this->height = height;
+
+	int size = getPaddedSize();
+
+	if (size > capacity)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			_mm_free(planes[i]);
+			planes[i] = (float *)_mm_malloc(sizeof(float) * size, 16);
+		}
+
+		capacity = size;
+	}
+
+	// padding stays black
+	for (int i = 0; i < 3; ++i)
+	{
+		memset(planes[i] + width * height, 0, sizeof(float) * (size - width * height));
+	}
+}
@@ -0,0 +1,427 @@
+#include "stdafx.h"
+
+#include "tracer.h"
+#include "scence.h"
+#include "demoScence.h"
+#include "imageWriter.h"
+#include "meshLoader.h"
+#include "renderService.h"
+
+#include <chrono>
+#include <string.h>
+
+
+struct HeadlessOptions
+{
+	int width = 1280;
+	int height = 720;
+	int depth = 8;
+	int antiAliasScale = 2;
+	int threadCount = 0;
+	int tileSize = 16;
+	int progressivePass = 0;
+	bool withSphereGrid = false;
+	bool wavefront = false;
+	float adaptiveThreshold = 0;
+	int adaptiveMaxSamples = 64;
+	float sampleBudget = 0;
+	const char *sampleMap = nullptr;
+	int temporalFrames = 0;
+	int serviceMoves = 0;
+	int moveInterval = 100;
+	const char *costMap = nullptr;
+	PixelCostMetric costMetric = PIXEL_COST_CYCLES;
+	ToneSettings tone;
+	const char *hdrOutput = nullptr;
+	const char *output = "render.ppm";
+	const char *mesh = nullptr;
+};
+
+
+void printUsage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"  -w <width>      image width, default 1280\n"
+		"  -h <height>     image height, default 720\n"
+		"  -d <depth>      trace depth, default 8\n"
+		"  -a <scale>      anti alias scale, scale * scale rays per pixel, default 2\n"
+		"  -t <threads>    render threads, 0 for all cores, default 0\n"
+		"  -s <size>       tile size, default 16\n"
+		"  -p <passes>     progressive render with one jittered sample per pass, ignore -a\n"
+		"  -g              add 7x4x4 sphere grid to demo scence\n"
+		"  -m <file>       replace glass sphere by .obj or .ply mesh\n"
+		"  -W              wavefront render, print time of each stage\n"
+		"  -A <threshold>  adaptive sampling until relative error of pixel is below threshold, -a * -a initial samples\n"
+		"  -c <samples>    most samples of a pixel with -A, default 64\n"
+		"  -b <spp>        sample budget with -A as average samples per pixel, 0 for no limit\n"
+		"  -S <file>       write sample count of every pixel with -A, white is -c samples\n"
+		"  -T <frames>     temporal render of frames while camera moves and turns, reuse pixels of last frame\n"
+		"  -L <moves>      render service, camera moves every -i ms, print input to first pixel latency\n"
+		"  -i <ms>         interval of camera moves with -L, default 100\n"
+		"  -H <file>       write cost of every pixel as false color heatmap, for the default render\n"
+		"  -C <metric>     cost of -H: cycles, tests (primitive tests and BVH nodes) or rays, default cycles\n"
+		"                  (tests and rays need USE_RENDER_STATS)\n"
+		"  -e <exposure>   scale of linear color before tone mapping, default 1\n"
+		"  -M <operator>   tone operator: clamp or reinhard, default clamp\n"
+		"  -G <gamma>      output gamma, default 1\n"
+		"  -F <file>       also write linear color as .pfm, not with -L\n"
+		"  -o <file>       output .ppm or .png, default render.ppm\n",
+		program);
+}
+
+
+bool parseOptions(int argc, char *argv[], HeadlessOptions &options)
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+
+		if (strcmp(arg, "-g") == 0)
+		{
+			options.withSphereGrid = true;
+			continue;
+		}
+
+		if (strcmp(arg, "-W") == 0)
+		{
+			options.wavefront = true;
+			continue;
+		}
+
+		if (arg[0] != '-' || strlen(arg) != 2 || i + 1 >= argc) return false;
+
+		const char *value = argv[++i];
+
+		switch (arg[1])
+		{
+		case 'w': options.width = atoi(value); break;
+		case 'h': options.height = atoi(value); break;
+		case 'd': options.depth = atoi(value); break;
+		case 'a': options.antiAliasScale = atoi(value); break;
+		case 't': options.threadCount = atoi(value); break;
+		case 's': options.tileSize = atoi(value); break;
+		case 'p': options.progressivePass = atoi(value); break;
+		case 'o': options.output = value; break;
+		case 'm': options.mesh = value; break;
+		case 'A': options.adaptiveThreshold = (float)atof(value); break;
+		case 'c': options.adaptiveMaxSamples = atoi(value); break;
+		case 'b': options.sampleBudget = (float)atof(value); break;
+		case 'S': options.sampleMap = value; break;
+		case 'T': options.temporalFrames = atoi(value); break;
+		case 'L': options.serviceMoves = atoi(value); break;
+		case 'i': options.moveInterval = atoi(value); break;
+		case 'H': options.costMap = value; break;
+		case 'e': options.tone.exposure = (float)atof(value); break;
+		case 'G': options.tone.gamma = (float)atof(value); break;
+		case 'F': options.hdrOutput = value; break;
+		case 'M':
+			if (strcmp(value, "clamp") == 0) options.tone.op = TONE_CLAMP;
+			else if (strcmp(value, "reinhard") == 0) options.tone.op = TONE_REINHARD;
+			else return false;
+			break;
+		case 'C':
+			if (strcmp(value, "cycles") == 0) options.costMetric = PIXEL_COST_CYCLES;
+#ifdef USE_RENDER_STATS
+			// tests and rays come from the render stats, without them every pixel costs 0
+			else if (strcmp(value, "tests") == 0) options.costMetric = PIXEL_COST_TESTS;
+			else if (strcmp(value, "rays") == 0) options.costMetric = PIXEL_COST_RAYS;
+#endif
+			else return false;
+			break;
+		default: return false;
+		}
+	}
+
+	return options.width > 0 && options.height > 0 && options.depth > 0 &&
+		options.antiAliasScale > 0 && options.threadCount >= 0 && options.tileSize > 0 && options.progressivePass >= 0 &&
+		options.adaptiveThreshold >= 0 && options.adaptiveMaxSamples > 0 && options.sampleBudget >= 0 &&
+		options.temporalFrames >= 0 && options.serviceMoves >= 0 && options.moveInterval >= 0 &&
+		options.tone.exposure > 0 && options.tone.gamma > 0 &&
+		(options.hdrOutput == nullptr || options.serviceMoves == 0);
+}
+
+
+// Move camera like -T every interval while the service renders, then wait for the frame of the last camera
+// Last frame is copied back to bitmap, rows bottom up
+void runRenderService(Scence &scence, Camera &camera, const HeadlessOptions &options, UINT32 *bitmap)
+{
+	TripleBuffer frames(options.width, options.height);
+
+	RenderServiceSettings settings;
+	settings.traceDepth = options.depth;
+	settings.antiAliasScale = options.antiAliasScale;
+
+	RenderService service(&scence, &frames, camera, settings);
+	service.getTracer().setTileSize(options.tileSize);
+	service.getTracer().setThreadCount(options.threadCount);
+	service.getTracer().setToneSettings(options.tone);
+	service.start();
+
+	for (int i = 0; i < options.serviceMoves; ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(options.moveInterval));
+
+		camera.moveX(10);
+		camera.turnByY(0.005f);
+		service.setCamera(camera);
+	}
+
+	RenderServiceStats stats = service.getStats();
+
+	while (stats.frames == 0 || stats.cameraVersion != camera.getVersion())
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		stats = service.getStats();
+	}
+
+	service.stop();
+
+	uint64_t sequence;
+	const UINT32 *frame = frames.acquire(sequence);
+
+	for (int y = 0; y < options.height; ++y)
+	{
+		memcpy(&bitmap[y * options.width], &frame[(options.height - y - 1) * options.width], sizeof(UINT32) * options.width);
+	}
+
+	printf("service: %d moves, %u frames, %u cancelled\n", options.serviceMoves, stats.frames, stats.cancelledFrames);
+	printf("latency ms: first pixel %.1f avg %.1f max, frame %.1f avg %.1f max\n",
+		stats.totalFirstPixelMs / stats.frames, stats.maxFirstPixelMs, stats.totalFrameMs / stats.frames, stats.maxFrameMs);
+}
+
+
+void printRenderStats(const RenderStats &stats)
+{
+	printf("rays of last frame: %llu camera, %llu reflection, %llu refraction, %llu diffuse, %llu shadow, max depth %d\n",
+		(unsigned long long)stats.cameraRays, (unsigned long long)stats.reflectionRays, (unsigned long long)stats.refractionRays,
+		(unsigned long long)stats.diffuseRays, (unsigned long long)stats.shadowRays, stats.maxDepth);
+	printf("%llu primitive tests, %llu BVH node visits, %llu nearest light calls, %.1f tests and %.1f nodes per ray\n",
+		(unsigned long long)stats.primitiveTests, (unsigned long long)stats.nodeVisits, (unsigned long long)stats.nearestLightCalls,
+		(double)stats.primitiveTests / max(stats.getRays(), (uint64_t)1), (double)stats.nodeVisits / max(stats.getRays(), (uint64_t)1));
+}
+
+
+bool endsWith(const char *str, const char *suffix)
+{
+	size_t strLength = strlen(str);
+	size_t suffixLength = strlen(suffix);
+
+	return strLength >= suffixLength && strcmp(str + strLength - suffixLength, suffix) == 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	HeadlessOptions options;
+
+	if (!parseOptions(argc, argv, options))
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+
+	Camera camera = createDemoCamera(options.width, options.height);
+
+	Scence scence;
+
+	if (options.mesh != nullptr)
+	{
+		IndexedMesh mesh;
+		MeshLoadStats stats;
+
+		if (!MeshLoader::load(options.mesh, mesh, stats))
+		{
+			fprintf(stderr, "can not load mesh %s\n", options.mesh);
+			return 1;
+		}
+
+		printf("%s: %.1f MB, %zu vertices, %zu triangles, map %.1f ms, parse %.1f ms, peak memory %.1f MB\n",
+			options.mesh, stats.fileBytes / 1048576.0, mesh.getVertexCount(), mesh.getTriangleCount(),
+			stats.mapMs, stats.parseMs, stats.peakMemoryBytes / 1048576.0);
+
+		buildMeshScence(scence, mesh);
+	}
+	else
+	{
+		buildDemoScence(scence, options.withSphereGrid);
+	}
+
+	auto buildStart = std::chrono::steady_clock::now();
+	scence.build();
+
+	printf("%zu objects, scence build %.1f ms, scence memory %.1f MB\n", scence.getAllObjects().size(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart).count(),
+		scence.getMemoryBytes() / 1048576.0);
+
+	Tracer rayTracer;
+	rayTracer.setSence(&scence);
+	rayTracer.setTileSize(options.tileSize);
+	rayTracer.setThreadCount(options.threadCount);
+	rayTracer.setToneSettings(options.tone);
+
+	std::vector<UINT32> bitmap(options.width * options.height);
+
+	uint64_t rays = 0;
+	RenderStats frameStats;		// all frames of the run
+	auto start = std::chrono::steady_clock::now();
+
+	if (options.serviceMoves > 0)
+	{
+		runRenderService(scence, camera, options, bitmap.data());
+	}
+	else if (options.progressivePass > 0)
+	{
+		for (int i = 0; i < options.progressivePass; ++i)
+		{
+			rayTracer.traceProgressive(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), bitmap.data());
+			rays += rayTracer.getCameraRayCount();
+			frameStats.merge(rayTracer.getRenderStats());
+		}
+	}
+	else if (options.temporalFrames > 0)
+	{
+		uint64_t tracedPixel = 0;
+
+		for (int i = 0; i < options.temporalFrames; ++i)
+		{
+			// a small step of the window program keys, every frame
+			if (i > 0)
+			{
+				camera.moveX(10);
+				camera.turnByY(0.005f);
+			}
+
+			tracedPixel += rayTracer.traceTemporal(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), options.antiAliasScale, bitmap.data());
+			rays += rayTracer.getCameraRayCount();
+			frameStats.merge(rayTracer.getRenderStats());
+		}
+
+		printf("temporal: %d frames, %.1f%% of pixels traced\n", options.temporalFrames,
+			100.0 * tracedPixel / ((double)options.temporalFrames * options.width * options.height));
+	}
+	else if (options.adaptiveThreshold > 0)
+	{
+		AdaptiveSettings settings;
+		settings.minSamples = options.antiAliasScale * options.antiAliasScale;
+		settings.maxSamples = options.adaptiveMaxSamples;
+		settings.threshold = options.adaptiveThreshold;
+		settings.sampleBudget = (uint64_t)(options.sampleBudget * options.width * options.height);
+
+		rayTracer.setAdaptiveSettings(settings);
+		rays = rayTracer.traceAdaptive(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), bitmap.data());
+
+		if (rays == 0)
+		{
+			fprintf(stderr, "sample budget %.2f is below 2 samples per pixel\n", options.sampleBudget);
+			return 1;
+		}
+
+		frameStats = rayTracer.getRenderStats();
+	}
+	else if (options.wavefront)
+	{
+		rayTracer.traceWavefront(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), options.antiAliasScale, bitmap.data());
+		rays = rayTracer.getCameraRayCount();
+		frameStats = rayTracer.getRenderStats();
+	}
+	else
+	{
+		if (options.costMap != nullptr) rayTracer.setPixelCostMetric(options.costMetric);
+
+		frameStats = rayTracer.trace(camera, options.depth, Color(0, 0, 0), Color(0, 0, 0), options.antiAliasScale, bitmap.data());
+		rays = rayTracer.getCameraRayCount();
+	}
+
+	auto end = std::chrono::steady_clock::now();
+	double seconds = std::chrono::duration<double>(end - start).count();
+
+	// throughput of every ray type, of camera rays only when the counters are compiled out
+#ifdef USE_RENDER_STATS
+	uint64_t totalRays = frameStats.getRays();
+	const char *rayType = "rays";
+#else
+	uint64_t totalRays = rays;
+	const char *rayType = "camera rays";
+#endif
+
+	printf("%dx%d depth %d %s %d: %.3f s, %llu camera rays, %.0f %s/s\n",
+		options.width, options.height, options.depth,
+		options.progressivePass > 0 ? "passes" : "aa", options.progressivePass > 0 ? options.progressivePass : options.antiAliasScale,
+		seconds, (unsigned long long)rays, totalRays / seconds, rayType);
+
+#ifdef USE_RENDER_STATS
+	if (options.serviceMoves == 0)
+	{
+		printRenderStats(rayTracer.getRenderStats());
+	}
+#endif
+
+	if (options.wavefront)
+	{
+		const WavefrontStats &stats = rayTracer.getWavefrontStats();
+
+		printf("stages ms: generate %.1f, intersect %.1f, sort %.1f, shade %.1f, shadow %.1f, accumulate %.1f\n",
+			stats.generateMs, stats.intersectMs, stats.sortMs, stats.shadeMs, stats.shadowMs, stats.accumulateMs);
+		printf("%llu path rays, %llu shadow rays, %d bounces\n",
+			(unsigned long long)stats.pathRays, (unsigned long long)stats.shadowRays, stats.bounces);
+	}
+
+	if (options.adaptiveThreshold > 0)
+	{
+		printf("adaptive: %.2f samples per pixel\n", (double)rays / (options.width * options.height));
+
+		if (options.sampleMap != nullptr)
+		{
+			std::vector<UINT32> sampleCounts(options.width * options.height);
+			sampleCountImage(rayTracer.getPixelEstimates(), options.adaptiveMaxSamples, sampleCounts.data());
+
+			bool isMapWritten = endsWith(options.sampleMap, ".png") ?
+				writePNG(options.sampleMap, sampleCounts.data(), options.width, options.height) :
+				writePPM(options.sampleMap, sampleCounts.data(), options.width, options.height);
+
+			if (!isMapWritten)
+			{
+				fprintf(stderr, "can not write %s\n", options.sampleMap);
+				return 1;
+			}
+		}
+	}
+
+	if (options.costMap != nullptr && !rayTracer.getPixelCosts().empty())
+	{
+		std::vector<UINT32> costMap(options.width * options.height);
+		uint64_t whiteCost = pixelCostImage(rayTracer.getPixelCosts(), costMap.data());
+
+		const char *metricNames[] = { "", "cycles", "tests", "rays" };
+		printf("heatmap: white is %llu %s per pixel or more\n", (unsigned long long)whiteCost, metricNames[options.costMetric]);
+
+		bool isMapWritten = endsWith(options.costMap, ".png") ?
+			writePNG(options.costMap, costMap.data(), options.width, options.height) :
+			writePPM(options.costMap, costMap.data(), options.width, options.height);
+
+		if (!isMapWritten)
+		{
+			fprintf(stderr, "can not write %s\n", options.costMap);
+			return 1;
+		}
+	}
+
+	if (options.hdrOutput != nullptr && !writePFM(options.hdrOutput, rayTracer.getHdrFrame()))
+	{
+		fprintf(stderr, "can not write %s\n", options.hdrOutput);
+		return 1;
+	}
+
+	bool isWritten = endsWith(options.output, ".png") ?
+		writePNG(options.output, bitmap.data(), options.width, options.height) :
+		writePPM(options.output, bitmap.data(), options.width, options.height);
+
+	if (!isWritten)
+	{
+		fprintf(stderr, "can not write %s\n", options.output);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include "hdrFrame.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+
+/*
+	Write bitmap of Tracer::trace to file, bitmap row 0 is the bottom of image.
+	Return false if file can not be written.
+*/
+
+inline bool writePPM(const char *path, const UINT32 *bitmap, int width, int height)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == nullptr) return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+
+	std::vector<uint8_t> row(width * 3);
+
+	for (int y = height - 1; y >= 0; --y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			UINT32 color = bitmap[x + y * width];
+			row[x * 3] = (color >> 16) & 0xff;
+			row[x * 3 + 1] = (color >> 8) & 0xff;
+			row[x * 3 + 2] = color & 0xff;
+		}
+
+		fwrite(row.data(), 1, row.size(), file);
+	}
+
+	return fclose(file) == 0;
+}
+
+
+class PngChunk
+{
+public:
+	PngChunk(const char *type)
+	{
+		data.insert(data.end(), type, type + 4);
+	}
+
+	void putByte(uint8_t value)
+	{
+		data.push_back(value);
+	}
+
+	void putUint32(uint32_t value)
+	{
+		putByte(value >> 24);
+		putByte(value >> 16);
+		putByte(value >> 8);
+		putByte(value);
+	}
+
+	void putBytes(const uint8_t *bytes, size_t size)
+	{
+		data.insert(data.end(), bytes, bytes + size);
+	}
+
+	void write(FILE *file) const
+	{
+		uint8_t header[4];
+		storeUint32(header, (uint32_t)data.size() - 4);
+		fwrite(header, 1, 4, file);
+
+		fwrite(data.data(), 1, data.size(), file);
+
+		// crc covers chunk type and data
+		uint8_t crc[4];
+		storeUint32(crc, calcCrc(data.data(), data.size()));
+		fwrite(crc, 1, 4, file);
+	}
+
+private:
+	static void storeUint32(uint8_t *bytes, uint32_t value)
+	{
+		bytes[0] = value >> 24;
+		bytes[1] = value >> 16;
+		bytes[2] = value >> 8;
+		bytes[3] = value;
+	}
+
+	static uint32_t calcCrc(const uint8_t *bytes, size_t size)
+	{
+		uint32_t crc = 0xffffffffu;
+
+		for (size_t i = 0; i < size; ++i)
+		{
+			crc ^= bytes[i];
+
+			for (int k = 0; k < 8; ++k)
+			{
+				crc = (crc >> 1) ^ (0xedb88320u & (0u - (crc & 1)));
+			}
+		}
+
+		return crc ^ 0xffffffffu;
+	}
+
+	std::vector<uint8_t> data;
+};
+
+
+// 8 bit RGB png, zlib stream is written with stored block so no compression library is needed
+inline bool writePNG(const char *path, const UINT32 *bitmap, int width, int height)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == nullptr) return false;
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	fwrite(signature, 1, 8, file);
+
+	PngChunk header("IHDR");
+	header.putUint32(width);
+	header.putUint32(height);
+	header.putByte(8);		// bit depth
+	header.putByte(2);		// color type RGB
+	header.putByte(0);
+	header.putByte(0);
+	header.putByte(0);
+	header.write(file);
+
+	// every scanline start with filter type 0
+	std::vector<uint8_t> raw;
+	raw.reserve((size_t)(width * 3 + 1) * height);
+
+	for (int y = height - 1; y >= 0; --y)
+	{
+		raw.push_back(0);
+
+		for (int x = 0; x < width; ++x)
+		{
+			UINT32 color = bitmap[x + y * width];
+			raw.push_back((color >> 16) & 0xff);
+			raw.push_back((color >> 8) & 0xff);
+			raw.push_back(color & 0xff);
+		}
+	}
+
+	PngChunk image("IDAT");
+	image.putByte(0x78);
+	image.putByte(0x01);
+
+	uint32_t adlerA = 1, adlerB = 0;
+
+	for (size_t offset = 0; ; offset += 0xffff)
+	{
+		size_t size = min(raw.size() - offset, (size_t)0xffff);
+		bool isLast = offset + size >= raw.size();
+
+		image.putByte(isLast ? 1 : 0);
+		image.putByte(size & 0xff);
+		image.putByte(size >> 8);
+		image.putByte(~size & 0xff);
+		image.putByte((~size >> 8) & 0xff);
+		image.putBytes(raw.data() + offset, size);
+
+		for (size_t i = offset; i < offset + size; ++i)
+		{
+			adlerA = (adlerA + raw[i]) % 65521;
+			adlerB = (adlerB + adlerA) % 65521;
+		}
+
+		if (isLast) break;
+	}
+
+	image.putUint32((adlerB << 16) | adlerA);
+	image.write(file);
+
+	PngChunk end("IEND");
+	end.write(file);
+
+	return fclose(file) == 0;
+}
+
+
+// Little endian float RGB portable float map of the linear frame at full precision, 1.0 is the white of 255
+// Rows of PFM go bottom up like bitmap
+inline bool writePFM(const char *path, const HdrFrame &frame)
+{
+	FILE *file = fopen(path, "wb");
+	if (file == nullptr) return false;
+
+	int width = frame.getWidth();
+	int height = frame.getHeight();
+
+	fprintf(file, "PF\n%d %d\n-1.0\n", width, height);
+
+	std::vector<float> row(width * 3);
+
+	for (int y = 0; y < height; ++y)
+	{
+		for (int x = 0; x < width; ++x)
+		{
+			Color color = frame.get(x + y * width);
+			row[x * 3] = color.r / 255.0f;
+			row[x * 3 + 1] = color.g / 255.0f;
+			row[x * 3 + 2] = color.b / 255.0f;
+		}
+
+		fwrite(row.data(), sizeof(float), row.size(), file);
+	}
+
+	return fclose(file) == 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vec.h"
+#include <vector>
+#include <stdint.h>
+
+
+// Shared vertex buffer and 32-bit triangle indices
+struct IndexedMesh
+{
+	size_t getVertexCount() const
+	{
+		return vertices.size() / 3;
+	}
+
+	size_t getTriangleCount() const
+	{
+		return indices.size() / 3;
+	}
+
+	Point3 getVertex(uint32_t i) const
+	{
+		return Point3(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2]);
+	}
+
+	// Scale and move mesh so its bounding box is centered at center and its longest side is size
+	void fit(const Point3 &center, float size)
+	{
+		if (vertices.empty()) return;
+
+		float low[3] = { vertices[0], vertices[1], vertices[2] };
+		float high[3] = { vertices[0], vertices[1], vertices[2] };
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			low[i % 3] = min(low[i % 3], vertices[i]);
+			high[i % 3] = max(high[i % 3], vertices[i]);
+		}
+
+		float longest = max(high[0] - low[0], max(high[1] - low[1], high[2] - low[2]));
+		float scale = longest > 0 ? size / longest : 1.0f;
+		float target[3] = { center.x, center.y, center.z };
+
+		for (size_t i = 0; i < vertices.size(); ++i)
+		{
+			int axis = i % 3;
+			vertices[i] = (vertices[i] - (low[axis] + high[axis]) * 0.5f) * scale + target[axis];
+		}
+	}
+
+	std::vector<float> vertices;		// x, y, z of every vertex
+	std::vector<uint32_t> indices;		// three vertex index per triangle
+};
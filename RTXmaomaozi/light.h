@@ -2,6 +2,7 @@
 #include "vec.h"
 #include "color.h"
 #include "aabb.h"
+#include "sampler.h"
 
 #define NO_INTERSECTION -1.0f
 
@@ -25,12 +26,26 @@ public:
 
 	virtual float getIntersection(const Point3 &emitPoint, const Vec3 &rayVec) const = 0;
 
-	virtual float sampleRayVec(const Point3  &emitPoint, Vec3 &newRayvec, float &ratio) = 0;
+	// Direction toward a point of light picked by u, v uniform in [0, 1), return distance to light
+	virtual float sampleRayVec(const Point3  &emitPoint, float u, float v, Vec3 &newRayvec, float &ratio) = 0;
 
 	virtual float getSampleRatio(const Point3  &emitPoint) = 0;
 
 	virtual Color getLightStrength(const Vec3 &lightDirection, float distance, const Vec3 &objNorm) const = 0;
 
+	// Directions light is emitted to, half angle is PI for light shining everywhere
+	virtual void getEmissionCone(Vec3 &axis, float &halfAngle) const
+	{
+		axis = Vec3(0, 0, 1);
+		halfAngle = PI;
+	}
+
+	// Sum of color channels times strength, used to compare lights
+	float getPower() const
+	{
+		return (color.r + color.g + color.b) * strength;
+	}
+
 	Point3 position;
 	float strength;
 	Color color;
@@ -71,36 +86,19 @@ public:
 		return sphereDistProjectOnRay - sqrtf(radiusSquare - sphereRayDistSquare);
 	}
 
-	virtual float sampleRayVec(const Point3  &emitPoint, Vec3 &newRayVec, float &ratio)
+	virtual float sampleRayVec(const Point3  &emitPoint, float u, float v, Vec3 &newRayVec, float &ratio)
 	{
 		Vec3 v1 = position - emitPoint;
 	
 		float lightDistance = v1.length();
 
-		//float targetCosAngle = sqrtf(lightDistance * lightDistance - radiusSquare * ((u(e) + 1.0f) / 2.0f)) / lightDistance;
-		float targetCosAngle = sqrtf(lightDistance * lightDistance - radiusSquare * ((float)rand() / (float)RAND_MAX)) / lightDistance;
+		float targetCosAngle = sqrtf(lightDistance * lightDistance - radiusSquare * u) / lightDistance;
 
 		float maxCosAngle = sqrtf(lightDistance * lightDistance - radiusSquare) / lightDistance;
 		ratio = acosf(maxCosAngle) / (2.0f * PI);
 
-		//Vec3 p(u(e), u(e), u(e));
-		Vec3 p
-		(
-			(float)rand() / (float)RAND_MAX * 2.0f - 1.0f, 
-			(float)rand() / (float)RAND_MAX * 2.0f - 1.0f,
-			(float)rand() / (float)RAND_MAX * 2.0f - 1.0f
-		);
-
-		p -= v1 * ((p * v1) / (v1 * v1));
-
-		p /= p.length();
-		p *= lightDistance;
-
-		newRayVec = v1 * targetCosAngle;
-		p *= sqrtf(1.0f - targetCosAngle * targetCosAngle);
-		newRayVec += p;
-
-		newRayVec.normalize();
+		v1 /= lightDistance;
+		newRayVec = coneDirection(v1, targetCosAngle, v);
 
 		return lightDistance;
 	}
@@ -158,6 +156,13 @@ public:
 		return std::move(c);
 	}
 
+	// Strength is below 1% outside the cone
+	void getEmissionCone(Vec3 &axis, float &halfAngle) const
+	{
+		axis = direct;
+		halfAngle = acosf(max(2.0f * powf(0.01f, decayRatio) - 1.0f, -1.0f));
+	}
+
 private:
 	Vec3 direct;
 	float decayRatio;
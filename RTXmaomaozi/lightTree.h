@@ -0,0 +1,273 @@
+#pragma once
+
+#include "vec.h"
+#include "light.h"
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+// Scences with more lights than this sample a few lights per shading point instead of every light
+#define LIGHT_TREE_MIN_LIGHTS 8
+// Lights picked per shading point, each contribution is divided by its probability
+#define LIGHT_TREE_SAMPLES 4
+// Lowest importance relative to power, keep every light reachable so sampling stays unbiased
+#define LIGHT_TREE_MIN_WEIGHT 1e-3f
+
+
+struct LightTreeNode
+{
+	float boundMin[3];
+	float boundMax[3];
+
+	float power;			// sum of light power below node
+	Vec3 axis;				// average emission direction
+	float spreadAngle;		// largest angle between axis and emission direction of any light below
+	float emissionAngle;	// largest emission half angle of any light below
+
+	uint32_t leftFirst;		// inner node: index of left child (right child is leftFirst + 1), leaf: light index
+	uint32_t count;			// 1 for leaf, 0 for inner node
+
+	LightTreeNode() : axis(0, 0, 0)
+	{
+		;
+	}
+
+	bool isLeaf() const
+	{
+		return count != 0;
+	}
+};
+
+
+/*
+	Binary tree over lights with bounds, power and emission cone of every subtree.
+	sample() walks down choosing a child by its estimated contribution to the shading point,
+	so cost per sample grows with log of light count. One light per leaf.
+*/
+class LightTree
+{
+public:
+	void build(const std::vector<VolumnLight *> &sceneLights);
+
+	void clear();
+
+	size_t getLightCount() const;
+
+	size_t getMemoryBytes() const;
+
+	// Pick one light for point, u is uniform in [0, 1)
+	// Return nullptr if there is no light, pdf is the probability the light was picked
+	VolumnLight *sample(const Point3 &point, float u, float &pdf) const;
+
+private:
+	void buildNode(uint32_t nodeIdx, uint32_t first, uint32_t count);
+
+	float importance(const LightTreeNode &node, const Point3 &point) const;
+
+	std::vector<LightTreeNode> nodes;
+	std::vector<VolumnLight *> lights;		// in leaf order
+};
+
+
+inline void LightTree::clear()
+{
+	nodes.clear();
+	lights.clear();
+}
+
+
+inline size_t LightTree::getLightCount() const
+{
+	return lights.size();
+}
+
+
+inline size_t LightTree::getMemoryBytes() const
+{
+	return nodes.capacity() * sizeof(LightTreeNode) + lights.capacity() * sizeof(VolumnLight *);
+}
+
+
+inline void LightTree::build(const std::vector<VolumnLight *> &sceneLights)
+{
+	clear();
+
+	if (sceneLights.empty()) return;
+
+	lights = sceneLights;
+	nodes.reserve(lights.size() * 2 - 1);
+	nodes.resize(1);
+
+	buildNode(0, 0, (uint32_t)lights.size());
+}
+
+
+inline void LightTree::buildNode(uint32_t nodeIdx, uint32_t first, uint32_t count)
+{
+	LightTreeNode node;
+	Vec3 axisSum(0, 0, 0);
+
+	node.power = 0;
+	node.emissionAngle = 0;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		node.boundMin[axis] = FLT_MAX;
+		node.boundMax[axis] = -FLT_MAX;
+	}
+
+	for (uint32_t i = first; i < first + count; ++i)
+	{
+		AABB box;
+		lights[i]->calcAABB(box);
+
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			node.boundMin[axis] = min(node.boundMin[axis], box.get_top_left()[axis]);
+			node.boundMax[axis] = max(node.boundMax[axis], box.get_down_right()[axis]);
+		}
+
+		Vec3 lightAxis(0, 0, 0);
+		float lightAngle;
+		lights[i]->getEmissionCone(lightAxis, lightAngle);
+
+		node.power += lights[i]->getPower();
+		node.emissionAngle = max(node.emissionAngle, lightAngle);
+		axisSum += lightAxis;
+	}
+
+	if (axisSum.length() > 1e-3f)
+	{
+		node.axis = axisSum;
+		node.axis.normalize();
+		node.spreadAngle = 0;
+
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			Vec3 lightAxis(0, 0, 0);
+			float lightAngle;
+			lights[i]->getEmissionCone(lightAxis, lightAngle);
+
+			node.spreadAngle = max(node.spreadAngle, node.axis.angle(lightAxis));
+		}
+	}
+	else
+	{
+		// axes cancel out, treat as shining everywhere
+		node.axis = Vec3(0, 0, 1);
+		node.spreadAngle = PI;
+	}
+
+	if (count == 1)
+	{
+		node.leftFirst = first;
+		node.count = 1;
+		nodes[nodeIdx] = node;
+		return;
+	}
+
+	// split at median of light positions along the longest axis
+	int splitAxis = 0;
+
+	for (int axis = 1; axis < 3; ++axis)
+	{
+		if (node.boundMax[axis] - node.boundMin[axis] > node.boundMax[splitAxis] - node.boundMin[splitAxis]) splitAxis = axis;
+	}
+
+	uint32_t half = count / 2;
+
+	std::nth_element(lights.begin() + first, lights.begin() + first + half, lights.begin() + first + count, [splitAxis](const VolumnLight *a, const VolumnLight *b)
+	{
+		return a->position[splitAxis] < b->position[splitAxis];
+	});
+
+	uint32_t leftIdx = (uint32_t)nodes.size();
+	nodes.resize(nodes.size() + 2);
+
+	node.leftFirst = leftIdx;
+	node.count = 0;
+	nodes[nodeIdx] = node;
+
+	buildNode(leftIdx, first, half);
+	buildNode(leftIdx + 1, first + half, count - half);
+}
+
+
+// Estimated light reaching point from the node: power over squared distance, and whether point may be inside an emission cone
+inline float LightTree::importance(const LightTreeNode &node, const Point3 &point) const
+{
+	if (node.isLeaf())
+	{
+		const VolumnLight *light = lights[node.leftFirst];
+
+		Vec3 lightDirection = light->position - point;
+		float distanceSquare = lightDirection * lightDirection;
+		float halfSize = (node.boundMax[0] - node.boundMin[0]) * 0.5f;
+
+		lightDirection.normalize();
+
+		Color strength = light->getLightStrength(lightDirection, sqrtf(distanceSquare), lightDirection);
+		float power = max(strength.r + strength.g + strength.b, node.power * LIGHT_TREE_MIN_WEIGHT);
+
+		return power / max(distanceSquare, halfSize * halfSize);
+	}
+
+	Point3 center((node.boundMin[0] + node.boundMax[0]) * 0.5f, (node.boundMin[1] + node.boundMax[1]) * 0.5f, (node.boundMin[2] + node.boundMax[2]) * 0.5f);
+	Vec3 halfDiagonal(node.boundMax[0] - center.x, node.boundMax[1] - center.y, node.boundMax[2] - center.z);
+
+	Vec3 toPoint = point - center;
+	float distanceSquare = toPoint * toPoint;
+	float radiusSquare = halfDiagonal * halfDiagonal;
+
+	if (distanceSquare <= radiusSquare) return node.power / radiusSquare;
+
+	float orientation = 1.0f;
+
+	if (node.spreadAngle + node.emissionAngle < PI)
+	{
+		// angle from the cone to point, less the angle bounds cover seen from point
+		float boundAngle = asinf(sqrtf(radiusSquare / distanceSquare));
+		float outsideAngle = node.axis.angle(toPoint) - node.spreadAngle - boundAngle;
+
+		if (outsideAngle > node.emissionAngle) orientation = LIGHT_TREE_MIN_WEIGHT;
+	}
+
+	return node.power * orientation / distanceSquare;
+}
+
+
+inline VolumnLight *LightTree::sample(const Point3 &point, float u, float &pdf) const
+{
+	pdf = 1.0f;
+
+	if (nodes.empty()) return nullptr;
+
+	const LightTreeNode *node = &nodes[0];
+
+	while (!node->isLeaf())
+	{
+		const LightTreeNode &left = nodes[node->leftFirst];
+		const LightTreeNode &right = nodes[node->leftFirst + 1];
+
+		float leftImportance = importance(left, point);
+		float rightImportance = importance(right, point);
+		float leftProbability = leftImportance + rightImportance > 0 ? leftImportance / (leftImportance + rightImportance) : 0.5f;
+
+		// reuse u for the next level by rescaling the chosen part back to [0, 1)
+		if (u < leftProbability)
+		{
+			u = min(u / leftProbability, 0.99999994f);
+			pdf *= leftProbability;
+			node = &left;
+		}
+		else
+		{
+			u = min((u - leftProbability) / (1.0f - leftProbability), 0.99999994f);
+			pdf *= 1.0f - leftProbability;
+			node = &right;
+		}
+	}
+
+	return lights[node->leftFirst];
+}
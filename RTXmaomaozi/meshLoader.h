@@ -0,0 +1,1058 @@
+#pragma once
+
+#include "indexedMesh.h"
+#include <vector>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+struct MeshLoadStats
+{
+	double mapMs = 0;
+	double parseMs = 0;
+	uint64_t fileBytes = 0;
+	uint64_t peakMemoryBytes = 0;		// peak resident memory of the process after loading
+};
+
+
+// Read only view of a whole file, unmapped on destruction
+class MappedFile
+{
+public:
+	MappedFile() {}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	bool open(const char *path);
+	void close();
+
+	const char *getData() const
+	{
+		return data;
+	}
+
+	size_t getSize() const
+	{
+		return size;
+	}
+
+private:
+	const char *data = nullptr;
+	size_t size = 0;
+
+#ifdef _WIN32
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE mapping = NULL;
+#endif
+};
+
+
+/*
+	Load triangle mesh from .obj or .ply (ascii or binary little endian).
+
+	File is memory mapped and cut into chunks at line boundary. Chunks are parsed
+	by all threads twice: first count vertices and triangles to get the offset of
+	every chunk in the output, then parse directly into place. Polygons are split
+	into triangle fans.
+*/
+class MeshLoader
+{
+public:
+	// Return false if file can not be read or is malformed
+	static bool load(const char *path, IndexedMesh &mesh, MeshLoadStats &stats);
+
+	static uint64_t getPeakMemoryBytes();
+
+private:
+	struct Chunk
+	{
+		const char *begin;
+		const char *end;
+
+		size_t firstLine;			// ply ascii only
+		size_t lineCount;
+		size_t firstVertex;
+		size_t vertexCount;
+		size_t firstTriangle;
+		size_t triangleCount;
+		bool isValid;
+	};
+
+	enum PlyType
+	{
+		PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_INVALID
+	};
+
+	struct PlyProperty
+	{
+		PlyType type;
+		PlyType countType;			// PLY_INVALID if property is not a list
+		char name[32];
+	};
+
+	struct PlyElement
+	{
+		char name[32];
+		size_t count;
+		std::vector<PlyProperty> properties;
+	};
+
+	static bool loadOBJ(const char *data, size_t size, IndexedMesh &mesh);
+	static bool loadPLY(const char *data, size_t size, IndexedMesh &mesh);
+	static bool loadPLYAscii(const char *data, size_t size, const std::vector<PlyElement> &elements, IndexedMesh &mesh);
+	static bool loadPLYBinary(const char *data, size_t size, const std::vector<PlyElement> &elements, IndexedMesh &mesh);
+
+	static std::vector<Chunk> splitLines(const char *data, size_t size);
+
+	static int getThreadCount()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	static const char *nextLine(const char *p, const char *end)
+	{
+		const char *lineEnd = (const char *)memchr(p, '\n', end - p);
+		return lineEnd == nullptr ? end : lineEnd + 1;
+	}
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	static const char *skipSpace(const char *p, const char *end)
+	{
+		while (p < end && isSpace(*p)) ++p;
+		return p;
+	}
+
+	static const char *skipToken(const char *p, const char *end)
+	{
+		while (p < end && !isSpace(*p) && *p != '\n') ++p;
+		return p;
+	}
+
+	// Number of whitespace separated tokens in [p, end)
+	static int countTokens(const char *p, const char *end)
+	{
+		int count = 0;
+
+		for (p = skipSpace(p, end); p < end && *p != '\n'; p = skipSpace(skipToken(p, end), end))
+		{
+			++count;
+		}
+
+		return count;
+	}
+
+	// Skip scalar properties before the vertex index list of an ascii ply face
+	static const char *skipFaceProperties(const char *p, const char *end, int indexProperty)
+	{
+		for (int i = 0; i < indexProperty; ++i)
+		{
+			p = skipToken(skipSpace(p, end), end);
+		}
+
+		return p;
+	}
+
+	static bool parseFloat(const char *&p, const char *end, float &value);
+	static bool parseInt(const char *&p, const char *end, int64_t &value);
+
+	static PlyType parsePlyType(const char *name, size_t length);
+	static size_t getPlyTypeSize(PlyType type);
+	static double readPlyValue(const char *p, PlyType type);
+	static bool skipPlyBytes(const char *&p, const char *end, size_t size);
+	static bool skipPlyList(const char *&p, const char *end, const PlyProperty &property, size_t &count);
+	static bool matchWord(const char *&p, const char *end, const char *word);
+	static void readWord(const char *&p, const char *end, char *word, size_t capacity);
+};
+
+
+inline bool MappedFile::open(const char *path)
+{
+	close();
+
+#ifdef _WIN32
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+	if (mapping == NULL)
+	{
+		close();
+		return false;
+	}
+
+	data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+
+	if (data == nullptr)
+	{
+		close();
+		return false;
+	}
+
+	size = (size_t)fileSize.QuadPart;
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat fileStat;
+
+	if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	void *mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+
+	if (mapped == MAP_FAILED) return false;
+
+	madvise(mapped, (size_t)fileStat.st_size, MADV_SEQUENTIAL);
+
+	data = (const char *)mapped;
+	size = (size_t)fileStat.st_size;
+#endif
+
+	return true;
+}
+
+
+inline void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data != nullptr) UnmapViewOfFile(data);
+	if (mapping != NULL) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+#else
+	if (data != nullptr) munmap((void *)data, size);
+#endif
+
+	data = nullptr;
+	size = 0;
+}
+
+
+inline bool MeshLoader::load(const char *path, IndexedMesh &mesh, MeshLoadStats &stats)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	MappedFile file;
+	if (!file.open(path)) return false;
+
+	auto mapped = std::chrono::steady_clock::now();
+
+	mesh.vertices.clear();
+	mesh.indices.clear();
+
+	bool isLoaded = file.getSize() >= 3 && memcmp(file.getData(), "ply", 3) == 0 ?
+		loadPLY(file.getData(), file.getSize(), mesh) :
+		loadOBJ(file.getData(), file.getSize(), mesh);
+
+	auto parsed = std::chrono::steady_clock::now();
+
+	stats.mapMs = std::chrono::duration<double, std::milli>(mapped - start).count();
+	stats.parseMs = std::chrono::duration<double, std::milli>(parsed - mapped).count();
+	stats.fileBytes = file.getSize();
+	stats.peakMemoryBytes = getPeakMemoryBytes();
+
+	return isLoaded;
+}
+
+
+inline uint64_t MeshLoader::getPeakMemoryBytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+	{
+		return counters.PeakWorkingSetSize;
+	}
+
+	return 0;
+#else
+	FILE *status = fopen("/proc/self/status", "r");
+	if (status == nullptr) return 0;
+
+	char line[256];
+	uint64_t peak = 0;
+
+	while (fgets(line, sizeof(line), status) != nullptr)
+	{
+		if (strncmp(line, "VmHWM:", 6) == 0)
+		{
+			peak = strtoull(line + 6, nullptr, 10) * 1024;
+			break;
+		}
+	}
+
+	fclose(status);
+	return peak;
+#endif
+}
+
+
+// About 8 chunks per thread, every chunk start at beginning of a line
+inline std::vector<MeshLoader::Chunk> MeshLoader::splitLines(const char *data, size_t size)
+{
+	size_t chunkCount = min((size_t)getThreadCount() * 8, size / 65536 + 1);
+	std::vector<Chunk> chunks;
+
+	const char *end = data + size;
+	const char *begin = data;
+
+	for (size_t i = 1; i <= chunkCount && begin < end; ++i)
+	{
+		const char *chunkEnd = i == chunkCount ? end : nextLine(max(data + size * i / chunkCount, begin), end);
+
+		Chunk chunk = {};
+		chunk.begin = begin;
+		chunk.end = chunkEnd;
+		chunk.isValid = true;
+		chunks.push_back(chunk);
+
+		begin = chunkEnd;
+	}
+
+	return chunks;
+}
+
+
+inline bool MeshLoader::parseFloat(const char *&p, const char *end, float &value)
+{
+	static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18 };
+
+	p = skipSpace(p, end);
+
+	bool isNegative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) ++p;
+
+	uint64_t mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool hasDigit = false;
+
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, hasDigit = true)
+	{
+		if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa > 0) ++digits; }
+		else ++exponent;
+	}
+
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, hasDigit = true)
+		{
+			if (digits < 18) { mantissa = mantissa * 10 + (*p - '0'); if (mantissa > 0) ++digits; --exponent; }
+		}
+	}
+
+	if (!hasDigit) return false;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		int64_t e;
+		if (!parseInt(p, end, e)) return false;
+		exponent += (int)max(min(e, (int64_t)400), (int64_t)-400);
+	}
+
+	double result = (double)mantissa;
+
+	for (; exponent > 0; exponent -= min(exponent, 18)) result *= powers[min(exponent, 18)];
+	for (; exponent < 0; exponent += min(-exponent, 18)) result /= powers[min(-exponent, 18)];
+
+	value = (float)(isNegative ? -result : result);
+	return true;
+}
+
+
+inline bool MeshLoader::parseInt(const char *&p, const char *end, int64_t &value)
+{
+	p = skipSpace(p, end);
+
+	bool isNegative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) ++p;
+
+	if (p == end || *p < '0' || *p > '9') return false;
+
+	value = 0;
+
+	for (; p < end && *p >= '0' && *p <= '9'; ++p)
+	{
+		// more digits than int64_t holds is malformed, not wrapped
+		if (value > (INT64_MAX - (*p - '0')) / 10) return false;
+
+		value = value * 10 + (*p - '0');
+	}
+
+	if (isNegative) value = -value;
+	return true;
+}
+
+
+inline bool MeshLoader::loadOBJ(const char *data, size_t size, IndexedMesh &mesh)
+{
+	std::vector<Chunk> chunks = splitLines(data, size);
+	int chunkCount = (int)chunks.size();
+
+	// pass 1, count vertices and triangles of every chunk
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		Chunk &chunk = chunks[i];
+
+		for (const char *line = chunk.begin; line < chunk.end; )
+		{
+			const char *lineEnd = nextLine(line, chunk.end);
+			const char *p = skipSpace(line, lineEnd);
+
+			if (p + 1 < lineEnd && isSpace(p[1]))
+			{
+				if (p[0] == 'v')
+				{
+					++chunk.vertexCount;
+				}
+				else if (p[0] == 'f')
+				{
+					int corners = countTokens(p + 1, lineEnd);
+					if (corners >= 3) chunk.triangleCount += corners - 2;
+				}
+			}
+
+			line = lineEnd;
+		}
+	}
+
+	size_t vertexCount = 0;
+	size_t triangleCount = 0;
+
+	for (Chunk &chunk : chunks)
+	{
+		chunk.firstVertex = vertexCount;
+		chunk.firstTriangle = triangleCount;
+
+		vertexCount += chunk.vertexCount;
+		triangleCount += chunk.triangleCount;
+	}
+
+	if (vertexCount > 0xffffffffu || triangleCount == 0) return false;
+
+	mesh.vertices.resize(vertexCount * 3);
+	mesh.indices.resize(triangleCount * 3);
+
+	// pass 2, parse in place, negative index is relative to vertices before the face
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		Chunk &chunk = chunks[i];
+
+		float *vertex = &mesh.vertices[chunk.firstVertex * 3];
+		uint32_t *index = &mesh.indices[chunk.firstTriangle * 3];
+		int64_t vertexBefore = (int64_t)chunk.firstVertex;
+
+		for (const char *line = chunk.begin; line < chunk.end && chunk.isValid; )
+		{
+			const char *lineEnd = nextLine(line, chunk.end);
+			const char *p = skipSpace(line, lineEnd);
+
+			if (p + 1 < lineEnd && isSpace(p[1]) && p[0] == 'v')
+			{
+				++p;
+				chunk.isValid = parseFloat(p, lineEnd, vertex[0]) && parseFloat(p, lineEnd, vertex[1]) && parseFloat(p, lineEnd, vertex[2]);
+
+				vertex += 3;
+				++vertexBefore;
+			}
+			else if (p + 1 < lineEnd && isSpace(p[1]) && p[0] == 'f' && countTokens(p + 1, lineEnd) >= 3)
+			{
+				++p;
+
+				uint32_t corner[2];
+				int corners = 0;
+
+				for (p = skipSpace(p, lineEnd); p < lineEnd && *p != '\n'; p = skipSpace(skipToken(p, lineEnd), lineEnd))
+				{
+					// v, v/vt, v//vn or v/vt/vn, only v is used
+					int64_t value;
+
+					if (!parseInt(p, lineEnd, value) || value == 0)
+					{
+						chunk.isValid = false;
+						break;
+					}
+
+					int64_t vertexIndex = value > 0 ? value - 1 : vertexBefore + value;
+
+					if (vertexIndex < 0 || vertexIndex >= (int64_t)vertexCount)
+					{
+						chunk.isValid = false;
+						break;
+					}
+
+					if (corners >= 2)
+					{
+						index[0] = corner[0];
+						index[1] = corner[1];
+						index[2] = (uint32_t)vertexIndex;
+						index += 3;
+
+						corner[1] = (uint32_t)vertexIndex;
+					}
+					else
+					{
+						corner[corners] = (uint32_t)vertexIndex;
+					}
+
+					++corners;
+				}
+			}
+
+			line = lineEnd;
+		}
+	}
+
+	for (const Chunk &chunk : chunks)
+	{
+		if (!chunk.isValid) return false;
+	}
+
+	return true;
+}
+
+
+inline MeshLoader::PlyType MeshLoader::parsePlyType(const char *name, size_t length)
+{
+	static const struct { const char *name; PlyType type; } types[] = {
+		{ "char", PLY_INT8 }, { "int8", PLY_INT8 }, { "uchar", PLY_UINT8 }, { "uint8", PLY_UINT8 },
+		{ "short", PLY_INT16 }, { "int16", PLY_INT16 }, { "ushort", PLY_UINT16 }, { "uint16", PLY_UINT16 },
+		{ "int", PLY_INT32 }, { "int32", PLY_INT32 }, { "uint", PLY_UINT32 }, { "uint32", PLY_UINT32 },
+		{ "float", PLY_FLOAT32 }, { "float32", PLY_FLOAT32 }, { "double", PLY_FLOAT64 }, { "float64", PLY_FLOAT64 }
+	};
+
+	for (auto &type : types)
+	{
+		if (strlen(type.name) == length && strncmp(type.name, name, length) == 0) return type.type;
+	}
+
+	return PLY_INVALID;
+}
+
+
+inline size_t MeshLoader::getPlyTypeSize(PlyType type)
+{
+	static const size_t sizes[] = { 1, 1, 2, 2, 4, 4, 4, 8, 0 };
+	return sizes[type];
+}
+
+
+// Binary little endian value of type at p
+inline double MeshLoader::readPlyValue(const char *p, PlyType type)
+{
+	switch (type)
+	{
+	case PLY_INT8: { int8_t v; memcpy(&v, p, 1); return v; }
+	case PLY_UINT8: { uint8_t v; memcpy(&v, p, 1); return v; }
+	case PLY_INT16: { int16_t v; memcpy(&v, p, 2); return v; }
+	case PLY_UINT16: { uint16_t v; memcpy(&v, p, 2); return v; }
+	case PLY_INT32: { int32_t v; memcpy(&v, p, 4); return v; }
+	case PLY_UINT32: { uint32_t v; memcpy(&v, p, 4); return v; }
+	case PLY_FLOAT32: { float v; memcpy(&v, p, 4); return v; }
+	case PLY_FLOAT64: { double v; memcpy(&v, p, 8); return v; }
+	default: return 0;
+	}
+}
+
+
+// Move p over size bytes, false without moving if fewer are left before end
+inline bool MeshLoader::skipPlyBytes(const char *&p, const char *end, size_t size)
+{
+	if (size > (size_t)(end - p)) return false;
+
+	p += size;
+	return true;
+}
+
+
+// Move p over binary list property and return its length, false if the list runs past end
+inline bool MeshLoader::skipPlyList(const char *&p, const char *end, const PlyProperty &property, size_t &count)
+{
+	const char *q = p;
+
+	if (!skipPlyBytes(q, end, getPlyTypeSize(property.countType))) return false;
+
+	// a negative or huge length can not fit either
+	double length = readPlyValue(p, property.countType);
+	if (!(length >= 0 && length <= (double)(end - q))) return false;
+
+	count = (size_t)length;
+
+	if (!skipPlyBytes(q, end, count * getPlyTypeSize(property.type))) return false;
+
+	p = q;
+	return true;
+}
+
+
+inline bool MeshLoader::matchWord(const char *&p, const char *end, const char *word)
+{
+	const char *q = skipSpace(p, end);
+	size_t length = strlen(word);
+
+	if ((size_t)(end - q) < length || strncmp(q, word, length) != 0) return false;
+	if (q + length < end && !isSpace(q[length]) && q[length] != '\n') return false;
+
+	p = q + length;
+	return true;
+}
+
+
+inline void MeshLoader::readWord(const char *&p, const char *end, char *word, size_t capacity)
+{
+	const char *q = skipSpace(p, end);
+	p = skipToken(q, end);
+
+	size_t length = min((size_t)(p - q), capacity - 1);
+	memcpy(word, q, length);
+	word[length] = '\0';
+}
+
+
+inline bool MeshLoader::loadPLY(const char *data, size_t size, IndexedMesh &mesh)
+{
+	const char *end = data + size;
+	const char *line = nextLine(data, end);
+
+	std::vector<PlyElement> elements;
+	bool isBinary = false;
+
+	for (;;)
+	{
+		if (line >= end) return false;
+
+		const char *lineEnd = nextLine(line, end);
+		const char *p = line;
+		line = lineEnd;
+
+		if (matchWord(p, lineEnd, "end_header")) break;
+
+		if (matchWord(p, lineEnd, "format"))
+		{
+			if (matchWord(p, lineEnd, "binary_little_endian")) isBinary = true;
+			else if (!matchWord(p, lineEnd, "ascii")) return false;
+		}
+		else if (matchWord(p, lineEnd, "element"))
+		{
+			PlyElement element;
+			readWord(p, lineEnd, element.name, sizeof(element.name));
+
+			int64_t count;
+			if (!parseInt(p, lineEnd, count) || count < 0) return false;
+
+			element.count = (size_t)count;
+			elements.push_back(element);
+		}
+		else if (matchWord(p, lineEnd, "property"))
+		{
+			if (elements.empty()) return false;
+
+			PlyProperty property;
+			property.countType = PLY_INVALID;
+
+			char typeName[32];
+			readWord(p, lineEnd, typeName, sizeof(typeName));
+
+			if (strcmp(typeName, "list") == 0)
+			{
+				readWord(p, lineEnd, typeName, sizeof(typeName));
+				property.countType = parsePlyType(typeName, strlen(typeName));
+				if (property.countType == PLY_INVALID) return false;
+
+				readWord(p, lineEnd, typeName, sizeof(typeName));
+			}
+
+			property.type = parsePlyType(typeName, strlen(typeName));
+			if (property.type == PLY_INVALID) return false;
+
+			readWord(p, lineEnd, property.name, sizeof(property.name));
+			elements.back().properties.push_back(property);
+		}
+	}
+
+	return isBinary ?
+		loadPLYBinary(line, end - line, elements, mesh) :
+		loadPLYAscii(line, end - line, elements, mesh);
+}
+
+
+inline bool MeshLoader::loadPLYAscii(const char *data, size_t size, const std::vector<PlyElement> &elements, IndexedMesh &mesh)
+{
+	// line range of vertex and face element, one element per line
+	size_t vertexLine = 0, vertexCount = 0, faceLine = 0, faceCount = 0;
+	int xyz[3] = { -1, -1, -1 };
+	int indexProperty = -1;
+	size_t line = 0;
+
+	for (const PlyElement &element : elements)
+	{
+		if (strcmp(element.name, "vertex") == 0)
+		{
+			vertexLine = line;
+			vertexCount = element.count;
+
+			for (size_t i = 0; i < element.properties.size(); ++i)
+			{
+				const char *name = element.properties[i].name;
+				if (name[0] >= 'x' && name[0] <= 'z' && name[1] == '\0') xyz[name[0] - 'x'] = (int)i;
+			}
+		}
+		else if (strcmp(element.name, "face") == 0)
+		{
+			faceLine = line;
+			faceCount = element.count;
+
+			for (size_t i = 0; i < element.properties.size(); ++i)
+			{
+				if (element.properties[i].countType != PLY_INVALID) indexProperty = (int)i;
+			}
+		}
+
+		line += element.count;
+	}
+
+	if (xyz[0] < 0 || xyz[1] < 0 || xyz[2] < 0 || indexProperty < 0 || faceCount == 0 || vertexCount > 0xffffffffu) return false;
+
+	std::vector<Chunk> chunks = splitLines(data, size);
+	int chunkCount = (int)chunks.size();
+
+	// pass 1, lines per chunk to know which element a line belongs to
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		for (const char *p = chunks[i].begin; p < chunks[i].end; p = nextLine(p, chunks[i].end))
+		{
+			++chunks[i].lineCount;
+		}
+	}
+
+	for (int i = 1; i < chunkCount; ++i)
+	{
+		chunks[i].firstLine = chunks[i - 1].firstLine + chunks[i - 1].lineCount;
+	}
+
+	// pass 2, triangles per chunk
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		Chunk &chunk = chunks[i];
+		size_t lineIndex = chunk.firstLine;
+
+		for (const char *p = chunk.begin; p < chunk.end; p = nextLine(p, chunk.end), ++lineIndex)
+		{
+			if (lineIndex < faceLine || lineIndex >= faceLine + faceCount) continue;
+
+			const char *lineEnd = nextLine(p, chunk.end);
+			const char *q = skipFaceProperties(p, lineEnd, indexProperty);
+			int64_t corners = 0;
+
+			// a polygon with more corners than vertices is malformed, checked before it sizes the index buffer
+			chunk.isValid = chunk.isValid && parseInt(q, lineEnd, corners) && corners >= 0 && corners <= (int64_t)vertexCount;
+			if (chunk.isValid && corners >= 3) chunk.triangleCount += (size_t)corners - 2;
+		}
+	}
+
+	size_t triangleCount = 0;
+
+	for (Chunk &chunk : chunks)
+	{
+		if (!chunk.isValid) return false;
+
+		chunk.firstTriangle = triangleCount;
+		triangleCount += chunk.triangleCount;
+	}
+
+	if (triangleCount == 0) return false;
+
+	mesh.vertices.resize(vertexCount * 3);
+	mesh.indices.resize(triangleCount * 3);
+
+	// pass 3, parse vertices and faces in place
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < chunkCount; ++i)
+	{
+		Chunk &chunk = chunks[i];
+		size_t lineIndex = chunk.firstLine;
+		uint32_t *index = &mesh.indices[chunk.firstTriangle * 3];
+
+		for (const char *p = chunk.begin; p < chunk.end && chunk.isValid; p = nextLine(p, chunk.end), ++lineIndex)
+		{
+			const char *lineEnd = nextLine(p, chunk.end);
+			const char *q = p;
+
+			if (lineIndex >= vertexLine && lineIndex < vertexLine + vertexCount)
+			{
+				float *vertex = &mesh.vertices[(lineIndex - vertexLine) * 3];
+				int propertyCount = max(xyz[0], max(xyz[1], xyz[2])) + 1;
+
+				for (int property = 0; property < propertyCount && chunk.isValid; ++property)
+				{
+					float value;
+					chunk.isValid = parseFloat(q, lineEnd, value);
+
+					if (property == xyz[0]) vertex[0] = value;
+					if (property == xyz[1]) vertex[1] = value;
+					if (property == xyz[2]) vertex[2] = value;
+				}
+			}
+			else if (lineIndex >= faceLine && lineIndex < faceLine + faceCount)
+			{
+				int64_t corners = 0;
+
+				q = skipFaceProperties(q, lineEnd, indexProperty);
+
+				if (!parseInt(q, lineEnd, corners))
+				{
+					chunk.isValid = false;
+					continue;
+				}
+
+				uint32_t corner[2];
+
+				for (int64_t c = 0; c < corners; ++c)
+				{
+					int64_t value;
+
+					if (!parseInt(q, lineEnd, value) || value < 0 || value >= (int64_t)vertexCount)
+					{
+						chunk.isValid = false;
+						break;
+					}
+
+					if (c >= 2)
+					{
+						index[0] = corner[0];
+						index[1] = corner[1];
+						index[2] = (uint32_t)value;
+						index += 3;
+
+						corner[1] = (uint32_t)value;
+					}
+					else
+					{
+						corner[c] = (uint32_t)value;
+					}
+				}
+			}
+		}
+	}
+
+	for (const Chunk &chunk : chunks)
+	{
+		if (!chunk.isValid) return false;
+	}
+
+	return true;
+}
+
+
+inline bool MeshLoader::loadPLYBinary(const char *data, size_t size, const std::vector<PlyElement> &elements, IndexedMesh &mesh)
+{
+	const char *p = data;
+	const char *end = data + size;
+
+	for (const PlyElement &element : elements)
+	{
+		bool isVertex = strcmp(element.name, "vertex") == 0;
+		bool isFace = strcmp(element.name, "face") == 0;
+
+		size_t fixedSize = 0;
+		bool hasList = false;
+
+		for (const PlyProperty &property : element.properties)
+		{
+			if (property.countType != PLY_INVALID) hasList = true;
+			else fixedSize += getPlyTypeSize(property.type);
+		}
+
+		if (isVertex && !hasList)
+		{
+			// fixed stride, every vertex is decoded independently
+			int offset[3] = { -1, -1, -1 };
+			PlyType type[3] = { PLY_INVALID, PLY_INVALID, PLY_INVALID };
+			size_t propertyOffset = 0;
+
+			for (const PlyProperty &property : element.properties)
+			{
+				const char *name = property.name;
+
+				if (name[0] >= 'x' && name[0] <= 'z' && name[1] == '\0')
+				{
+					offset[name[0] - 'x'] = (int)propertyOffset;
+					type[name[0] - 'x'] = property.type;
+				}
+
+				propertyOffset += getPlyTypeSize(property.type);
+			}
+
+			if (offset[0] < 0 || offset[1] < 0 || offset[2] < 0 || fixedSize == 0 || element.count > 0xffffffffu) return false;
+			if ((size_t)(end - p) / fixedSize < element.count) return false;
+
+			mesh.vertices.resize(element.count * 3);
+			int64_t vertexCount = (int64_t)element.count;
+
+#pragma omp parallel for schedule(static)
+			for (int64_t i = 0; i < vertexCount; ++i)
+			{
+				const char *vertex = p + i * fixedSize;
+
+				mesh.vertices[i * 3] = (float)readPlyValue(vertex + offset[0], type[0]);
+				mesh.vertices[i * 3 + 1] = (float)readPlyValue(vertex + offset[1], type[1]);
+				mesh.vertices[i * 3 + 2] = (float)readPlyValue(vertex + offset[2], type[2]);
+			}
+
+			p += element.count * fixedSize;
+		}
+		else if (isFace)
+		{
+			// faces have variable length, walk them once for offsets, then decode in parallel
+			std::vector<const char *> listStart(element.count);
+			std::vector<size_t> firstTriangle(element.count + 1, 0);
+			const PlyProperty *list = nullptr;
+
+			for (size_t face = 0; face < element.count; ++face)
+			{
+				for (const PlyProperty &property : element.properties)
+				{
+					if (property.countType == PLY_INVALID)
+					{
+						if (!skipPlyBytes(p, end, getPlyTypeSize(property.type))) return false;
+						continue;
+					}
+
+					const char *start = p;
+					size_t count;
+
+					if (!skipPlyList(p, end, property, count)) return false;
+
+					if (list == nullptr || list == &property)
+					{
+						list = &property;
+						listStart[face] = start;
+						firstTriangle[face + 1] = count >= 3 ? count - 2 : 0;
+					}
+				}
+
+				firstTriangle[face + 1] += firstTriangle[face];
+			}
+
+			if (list == nullptr || firstTriangle[element.count] == 0) return false;
+
+			mesh.indices.resize(firstTriangle[element.count] * 3);
+
+			int64_t faceCount = (int64_t)element.count;
+			uint32_t vertexCount = (uint32_t)mesh.getVertexCount();
+			bool isValid = true;
+
+#pragma omp parallel for schedule(dynamic, 4096) reduction(&&:isValid)
+			for (int64_t face = 0; face < faceCount; ++face)
+			{
+				const char *q = listStart[face];
+				size_t corners = (size_t)readPlyValue(q, list->countType);
+				size_t indexSize = getPlyTypeSize(list->type);
+				uint32_t *index = &mesh.indices[firstTriangle[face] * 3];
+
+				q += getPlyTypeSize(list->countType);
+
+				// a face of less than 3 corners may end the file right after its length
+				if (corners < 3) continue;
+
+				uint32_t first = (uint32_t)readPlyValue(q, list->type);
+
+				for (size_t c = 2; c < corners; ++c)
+				{
+					uint32_t b = (uint32_t)readPlyValue(q + (c - 1) * indexSize, list->type);
+					uint32_t v = (uint32_t)readPlyValue(q + c * indexSize, list->type);
+
+					if (first >= vertexCount || b >= vertexCount || v >= vertexCount)
+					{
+						isValid = false;
+					}
+
+					index[0] = first;
+					index[1] = b;
+					index[2] = v;
+					index += 3;
+				}
+			}
+
+			if (!isValid) return false;
+		}
+		else if (!hasList)
+		{
+			if (fixedSize > 0 && (size_t)(end - p) / fixedSize < element.count) return false;
+
+			p += element.count * fixedSize;
+		}
+		else
+		{
+			for (size_t i = 0; i < element.count; ++i)
+			{
+				for (const PlyProperty &property : element.properties)
+				{
+					size_t count;
+
+					if (property.countType == PLY_INVALID)
+					{
+						if (!skipPlyBytes(p, end, getPlyTypeSize(property.type))) return false;
+					}
+					else if (!skipPlyList(p, end, property, count))
+					{
+						return false;
+					}
+				}
+			}
+		}
+	}
+
+	return mesh.getVertexCount() > 0 && mesh.getTriangleCount() > 0;
+}
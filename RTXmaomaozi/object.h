@@ -4,11 +4,23 @@
 #include "aabb.h"
 
 #define NO_INTERSECTION -1.0f
+#define NO_SCENE_SLOT 0xffffffffu
 
 
 class Object;
 
 
+// Concrete type of an object, hot loops switch on it instead of calling virtual functions
+// Triangles come first so they lead every BVH leaf, see Scence::build()
+enum ObjectType : uint8_t
+{
+	OBJECT_TRIANGLE,
+	OBJECT_SPHERE,
+	OBJECT_PLANE,
+	OBJECT_CHEESE_PLANE
+};
+
+
 struct Intersection
 {
 	Intersection(Point3 intersectionPoint, Object *obj) :
@@ -36,7 +48,8 @@ class Object
 
 public:
 
-	Object(const Color &reflectionRatio, const Color & refractionRatio, float refractionEta, float diffuseFactor) :
+	Object(ObjectType type, const Color &reflectionRatio, const Color & refractionRatio, float refractionEta, float diffuseFactor) :
+		type(type),
 		reflectionRatio(reflectionRatio),
 		refractionRatio(refractionRatio),
 		refractionEta(refractionEta),
@@ -75,6 +88,11 @@ public:
 		return false;
 	}
 
+	ObjectType getType() const
+	{
+		return type;
+	}
+
 	float getRefractionEta() const
 	{
 		return refractionEta;
@@ -85,14 +103,28 @@ public:
 		return diffuseFactor;
 	}
 
+	// Index in Scence::getBvhObjects(), assigned by Scence::build()
+	uint32_t getSceneSlot() const
+	{
+		return sceneSlot;
+	}
+
+	void setSceneSlot(uint32_t slot)
+	{
+		sceneSlot = slot;
+	}
+
 
 protected:
+	ObjectType type;
 	Color reflectionRatio;
 	Color refractionRatio;
 	Color totalRefractionRatio;
 	float refractionEta;
 	float refractionEtaEntry;
 	float diffuseFactor;
+
+	uint32_t sceneSlot = NO_SCENE_SLOT;
 };
 
 
@@ -102,13 +134,24 @@ class Sphere : public Object
 public:
 
 	Sphere(const Point3 &center, float radius, const Color &reflectionRatio, const Color &refractionRatio, float refractionEta, float diffuseFactor) :
-		Object(reflectionRatio, refractionRatio, refractionEta, diffuseFactor),
+		Object(OBJECT_SPHERE, reflectionRatio, refractionRatio, refractionEta, diffuseFactor),
 		center(center),
 		radius(radius)
 	{
 		radiusSquare = radius * radius;
 	}
 
+	const Point3 &getCenter() const
+	{
+		return center;
+	}
+
+	// Moved sphere is seen by rays after Scence::update()
+	void setCenter(const Point3 &newCenter)
+	{
+		center = newCenter;
+	}
+
 
 	void getNormVecAt(const Point3 &point, Vec3 &norm) const
 	{
@@ -204,7 +247,7 @@ class Plane : public Object
 public:
 
 	Plane(const Vec3 &normVec, const Point3 &pointOnPlane, const Color &reflectionRatio, float diffuseFactor) :
-		Object(reflectionRatio, Color(0.0f, 0.0f, 0.0f), 1.0f, diffuseFactor),
+		Object(OBJECT_PLANE, reflectionRatio, Color(0.0f, 0.0f, 0.0f), 1.0f, diffuseFactor),
 		normVec(normVec),
 		pointOnPlane(pointOnPlane),
 		base1(0, 0, 0), base2(0, 0, 0)
@@ -288,7 +331,11 @@ class CheesePlane : public Plane
 {
 public:
 
-	using Plane::Plane;
+	CheesePlane(const Vec3 &normVec, const Point3 &pointOnPlane, const Color &reflectionRatio, float diffuseFactor) :
+		Plane(normVec, pointOnPlane, reflectionRatio, diffuseFactor)
+	{
+		type = OBJECT_CHEESE_PLANE;
+	}
 
 	virtual const Color &getReflectionRatio(const Point3 &point) const
 	{
@@ -316,7 +363,7 @@ class Triangle : public Object
 public:
 
 	Triangle(const Point3 &pointA, const Point3 &pointB, const Point3 &pointC, const Color &reflectionRatio, const Color &refractionRatio, float refractionEta, float diffuseFactor) :
-		Object(reflectionRatio, refractionRatio, refractionEta, diffuseFactor), 
+		Object(OBJECT_TRIANGLE, reflectionRatio, refractionRatio, refractionEta, diffuseFactor), 
 		pointA(pointA), pointB(pointB), pointC(pointC), 
 		pointAB(pointB - pointA), pointAC(pointC - pointA),
 		normVec(pointAB.xmul(pointAC))
@@ -324,6 +371,19 @@ public:
 		normVec.normalize();
 	}
 
+	// Moved triangle is seen by rays after Scence::update()
+	void setPoints(const Point3 &newPointA, const Point3 &newPointB, const Point3 &newPointC)
+	{
+		pointA = newPointA;
+		pointB = newPointB;
+		pointC = newPointC;
+		pointAB = pointB - pointA;
+		pointAC = pointC - pointA;
+
+		normVec = pointAB.xmul(pointAC);
+		normVec.normalize();
+	}
+
 
 	void getNormVecAt(const Point3 &point, Vec3 &norm) const
 	{
@@ -381,6 +441,22 @@ public:
 		return t;
 	}
 
+
+	const Point3 &getPointA() const
+	{
+		return pointA;
+	}
+
+	const Vec3 &getEdgeAB() const
+	{
+		return pointAB;
+	}
+
+	const Vec3 &getEdgeAC() const
+	{
+		return pointAC;
+	}
+
 	const Color &getReflectionRatio(const Point3 &point) const
 	{
 		return reflectionRatio;
@@ -415,4 +491,90 @@ protected:
 	Vec3 pointAC;
 
 	Vec3 normVec;
-};
\ No newline at end of file
+};
+
+
+/*
+	Shading calls resolved by the type tag, every case is a qualified call the compiler can inline.
+	Results are the same as the virtual functions of Object.
+*/
+struct ObjectDispatch
+{
+	static float getIntersection(const Object *obj, const Point3 &emitPoint, const Vec3 &rayVec, bool isInMedium)
+	{
+		switch (obj->getType())
+		{
+		case OBJECT_TRIANGLE:
+			return static_cast<const Triangle *>(obj)->Triangle::getIntersection(emitPoint, rayVec, isInMedium);
+		case OBJECT_SPHERE:
+			return static_cast<const Sphere *>(obj)->Sphere::getIntersection(emitPoint, rayVec, isInMedium);
+		default:
+			return static_cast<const Plane *>(obj)->Plane::getIntersection(emitPoint, rayVec, isInMedium);
+		}
+	}
+
+	static void getNormVecAt(const Object *obj, const Point3 &point, Vec3 &norm)
+	{
+		switch (obj->getType())
+		{
+		case OBJECT_TRIANGLE:
+			static_cast<const Triangle *>(obj)->Triangle::getNormVecAt(point, norm);
+			break;
+		case OBJECT_SPHERE:
+			static_cast<const Sphere *>(obj)->Sphere::getNormVecAt(point, norm);
+			break;
+		default:
+			static_cast<const Plane *>(obj)->Plane::getNormVecAt(point, norm);
+			break;
+		}
+	}
+
+	static void calcReflectionRay(const Object *obj, const Point3 &reflectionPoint, const Vec3 &rayVec, Vec3 &reflectionRay)
+	{
+		switch (obj->getType())
+		{
+		case OBJECT_TRIANGLE:
+			static_cast<const Triangle *>(obj)->Triangle::calcReflectionRay(reflectionPoint, rayVec, reflectionRay);
+			break;
+		case OBJECT_SPHERE:
+			static_cast<const Sphere *>(obj)->Sphere::calcReflectionRay(reflectionPoint, rayVec, reflectionRay);
+			break;
+		default:
+			static_cast<const Plane *>(obj)->Plane::calcReflectionRay(reflectionPoint, rayVec, reflectionRay);
+			break;
+		}
+	}
+
+	static bool calcRefractionRay(const Object *obj, const Point3 &refractionPoint, const Vec3 &rayVec, bool isInMedium, Vec3 &refractionRay)
+	{
+		switch (obj->getType())
+		{
+		case OBJECT_TRIANGLE:
+			return static_cast<const Triangle *>(obj)->Triangle::calcRefractionRay(refractionPoint, rayVec, isInMedium, refractionRay);
+		case OBJECT_SPHERE:
+			return static_cast<const Sphere *>(obj)->Sphere::calcRefractionRay(refractionPoint, rayVec, isInMedium, refractionRay);
+		default:
+			return static_cast<const Plane *>(obj)->Plane::calcRefractionRay(refractionPoint, rayVec, isInMedium, refractionRay);
+		}
+	}
+
+	static const Color &getReflectionRatio(const Object *obj, const Point3 &point)
+	{
+		if (obj->getType() == OBJECT_CHEESE_PLANE)
+		{
+			return static_cast<const CheesePlane *>(obj)->CheesePlane::getReflectionRatio(point);
+		}
+
+		return obj->Object::getReflectionRatio(point);
+	}
+
+	static const Color &getRefractionRatio(const Object *obj, const Point3 &point)
+	{
+		return obj->Object::getRefractionRatio(point);
+	}
+
+	static const Color &getTotalReflectionRatio(const Object *obj, const Point3 &point)
+	{
+		return obj->Object::getTotalReflectionRatio(point);
+	}
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "renderStats.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdint.h>
+
+
+// Share of most expensive pixels drawn white, so a few outliers do not make the rest of the map dark
+#define PIXEL_COST_SATURATED 0.005f
+
+
+enum PixelCostMetric
+{
+	PIXEL_COST_NONE,
+	PIXEL_COST_CYCLES,		// time stamp counter, includes whatever the OS does on that core meanwhile
+	PIXEL_COST_TESTS,		// primitive tests and BVH node visits, need USE_RENDER_STATS
+	PIXEL_COST_RAYS,		// rays of every type, need USE_RENDER_STATS
+};
+
+
+// Running counter of calling thread for metric, the cost of a pixel is its difference before and after the pixel
+inline uint64_t readPixelCost(PixelCostMetric metric)
+{
+	switch (metric)
+	{
+	case PIXEL_COST_CYCLES:
+		return __rdtsc();
+#ifdef USE_RENDER_STATS
+	case PIXEL_COST_TESTS:
+		return threadRenderStats().primitiveTests + threadRenderStats().nodeVisits;
+	case PIXEL_COST_RAYS:
+		return threadRenderStats().getRays();
+#endif
+	default:
+		return 0;
+	}
+}
+
+
+// Cost of every pixel in false color on log scale, black for no cost, then blue, cyan, green, yellow, red and white
+// Return the cost drawn white
+inline uint64_t pixelCostImage(const std::vector<uint64_t> &costs, UINT32 *bitmap)
+{
+	static const float ramp[][3] = {
+		{ 0, 0, 0 }, { 0, 0, 255 }, { 0, 255, 255 }, { 0, 255, 0 }, { 255, 255, 0 }, { 255, 0, 0 }, { 255, 255, 255 }
+	};
+	const int rampSteps = sizeof(ramp) / sizeof(ramp[0]) - 1;
+
+	if (costs.empty()) return 0;
+
+	std::vector<uint64_t> sorted(costs);
+	size_t saturated = min((size_t)(sorted.size() * (1.0f - PIXEL_COST_SATURATED)), sorted.size() - 1);
+	std::nth_element(sorted.begin(), sorted.begin() + saturated, sorted.end());
+
+	uint64_t whiteCost = max(sorted[saturated], (uint64_t)1);
+	float scale = 1.0f / logf(1.0f + whiteCost);
+
+	for (size_t i = 0; i < costs.size(); ++i)
+	{
+		float t = min(logf(1.0f + costs[i]) * scale, 1.0f) * rampSteps;
+		int step = min((int)t, rampSteps - 1);
+		float f = t - step;
+
+		UINT32 color = 0;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			color = (color << 8) | (UINT32)(ramp[step][c] + (ramp[step + 1][c] - ramp[step][c]) * f);
+		}
+
+		bitmap[i] = color;
+	}
+
+	return whiteCost;
+}
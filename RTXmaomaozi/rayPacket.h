@@ -0,0 +1,66 @@
+#pragma once
+
+#include "vec.h"
+#include <string.h>
+
+#define RAY_PACKET_SIZE 4
+
+
+// RAY_PACKET_SIZE rays in structure of arrays layout, lane i of every array belongs to ray i
+struct alignas(16) RayPacket
+{
+	RayPacket() : activeMask(0)
+	{
+		// inactive lanes still go through the SIMD math, stack garbage there may be denormal and very slow
+		memset(this, 0, sizeof(RayPacket));
+	}
+
+	void setRay(int lane, const Point3 &origin, const Vec3 &direct)
+	{
+		originX[lane] = origin.x;
+		originY[lane] = origin.y;
+		originZ[lane] = origin.z;
+
+		directX[lane] = direct.x;
+		directY[lane] = direct.y;
+		directZ[lane] = direct.z;
+
+		// avoid inf * 0 = nan while ray is parallel to a slab
+		invDirectX[lane] = 1.0f / (fabsf(direct.x) > 1e-20f ? direct.x : (direct.x < 0 ? -1e-20f : 1e-20f));
+		invDirectY[lane] = 1.0f / (fabsf(direct.y) > 1e-20f ? direct.y : (direct.y < 0 ? -1e-20f : 1e-20f));
+		invDirectZ[lane] = 1.0f / (fabsf(direct.z) > 1e-20f ? direct.z : (direct.z < 0 ? -1e-20f : 1e-20f));
+
+		activeMask |= 1 << lane;
+	}
+
+	Point3 getOrigin(int lane) const
+	{
+		return Point3(originX[lane], originY[lane], originZ[lane]);
+	}
+
+	Vec3 getDirect(int lane) const
+	{
+		return Vec3(directX[lane], directY[lane], directZ[lane]);
+	}
+
+	// Expand a lane bit mask to a SSE compare style mask
+	static __m128 laneMask(int mask)
+	{
+		__m128i bits = _mm_and_si128(_mm_set1_epi32(mask), _mm_setr_epi32(1, 2, 4, 8));
+		return _mm_castsi128_ps(_mm_cmpgt_epi32(bits, _mm_setzero_si128()));
+	}
+
+	float originX[RAY_PACKET_SIZE];
+	float originY[RAY_PACKET_SIZE];
+	float originZ[RAY_PACKET_SIZE];
+
+	float directX[RAY_PACKET_SIZE];
+	float directY[RAY_PACKET_SIZE];
+	float directZ[RAY_PACKET_SIZE];
+
+	float invDirectX[RAY_PACKET_SIZE];
+	float invDirectY[RAY_PACKET_SIZE];
+	float invDirectZ[RAY_PACKET_SIZE];
+
+	int activeMask;
+};
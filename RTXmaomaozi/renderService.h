@@ -0,0 +1,235 @@
+#pragma once
+
+#include "tracer.h"
+#include "tripleBuffer.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+
+struct RenderServiceSettings
+{
+	int traceDepth = 8;
+	int antiAliasScale = 1;			// of the first frame after camera changes
+	int maxPasses = 256;			// progressive passes while camera is idle
+};
+
+
+// Latency from setCamera() to the frame for that camera, input arriving before the frame started is timed from the first one
+struct RenderServiceStats
+{
+	uint32_t frames = 0;			// frames published for a new camera
+	uint32_t cancelledFrames = 0;	// frames and passes cancelled by a newer camera
+	uint32_t cameraVersion = 0;		// camera of the last published frame
+
+	double firstPixelMs = 0;		// first tile of the last frame finished
+	double frameMs = 0;				// last frame published
+	double maxFirstPixelMs = 0;
+	double maxFrameMs = 0;
+	double totalFirstPixelMs = 0;
+	double totalFrameMs = 0;
+};
+
+
+/*
+	Render thread that keeps a built scence and renders it for the newest camera until stopped.
+	A new camera cancels the frame in flight as soon as the tiles being rendered are finished, and the first frame for
+	it reuses pixels of the last one by Tracer::traceTemporal(). While camera is idle the image is refined by
+	progressive passes. Every finished frame is published to the triple buffer, cancelled ones are dropped.
+*/
+class RenderService
+{
+public:
+	RenderService(Scence *scence, TripleBuffer *frames, const Camera &camera, const RenderServiceSettings &settings = RenderServiceSettings());
+	~RenderService();
+
+	RenderService(const RenderService &) = delete;
+	RenderService &operator=(const RenderService &) = delete;
+
+	// Tile size and thread count must be set before start()
+	Tracer &getTracer();
+
+	void start();
+	void stop();
+
+	// Any thread: render camera from now on
+	void setCamera(const Camera &camera);
+
+	RenderServiceStats getStats() const;
+
+private:
+	void run();
+
+	void addFrameStats(uint32_t cameraVersion, std::chrono::steady_clock::time_point requestTime);
+
+	static double elapsedMs(std::chrono::steady_clock::time_point from, std::chrono::steady_clock::time_point to)
+	{
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	}
+
+	Tracer tracer;
+	TripleBuffer *frames;
+	RenderServiceSettings settings;
+
+	std::thread worker;
+	std::atomic<bool> cancelFlag{ false };
+
+	// guarded by mutex
+	mutable std::mutex mutex;
+	std::condition_variable wake;
+	Camera camera;
+	std::chrono::steady_clock::time_point cameraTime;
+	bool isCameraChanged = false;
+	bool isRunning = false;
+	RenderServiceStats stats;
+};
+
+
+inline RenderService::RenderService(Scence *scence, TripleBuffer *frames, const Camera &camera, const RenderServiceSettings &settings) :
+	frames(frames), settings(settings), camera(camera)
+{
+	tracer.setSence(scence);
+	tracer.setCancelFlag(&cancelFlag);
+
+	// frames are tone mapped straight into the back buffer in the order they are shown
+	tracer.setBitmapTopDown(true);
+}
+
+
+inline RenderService::~RenderService()
+{
+	stop();
+}
+
+
+inline Tracer &RenderService::getTracer()
+{
+	return tracer;
+}
+
+
+inline void RenderService::start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (isRunning) return;
+
+	isRunning = true;
+	isCameraChanged = true;
+	cameraTime = std::chrono::steady_clock::now();
+	cancelFlag = false;
+
+	worker = std::thread(&RenderService::run, this);
+}
+
+
+inline void RenderService::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		isRunning = false;
+		cancelFlag = true;
+	}
+
+	wake.notify_one();
+
+	if (worker.joinable()) worker.join();
+}
+
+
+inline void RenderService::setCamera(const Camera &newCamera)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!isCameraChanged) cameraTime = std::chrono::steady_clock::now();
+
+		camera = newCamera;
+		isCameraChanged = true;
+		cancelFlag = true;
+	}
+
+	wake.notify_one();
+}
+
+
+inline RenderServiceStats RenderService::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return stats;
+}
+
+
+inline void RenderService::run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	Camera frameCamera = camera;
+	std::chrono::steady_clock::time_point frameCameraTime = cameraTime;
+	bool isFramePending = false;
+	int pass = settings.maxPasses;
+
+	while (true)
+	{
+		wake.wait(lock, [&]() { return !isRunning || isCameraChanged || isFramePending || pass < settings.maxPasses; });
+
+		if (!isRunning) break;
+
+		if (isCameraChanged)
+		{
+			frameCamera = camera;
+			frameCameraTime = cameraTime;
+			isCameraChanged = false;
+			isFramePending = true;
+			cancelFlag = false;
+		}
+
+		lock.unlock();
+
+		if (isFramePending)
+		{
+			tracer.traceTemporal(frameCamera, settings.traceDepth, Color(0, 0, 0), Color(0, 0, 0), settings.antiAliasScale, frames->getBackBuffer());
+
+			if (!tracer.wasCancelled())
+			{
+				frames->publish();
+				isFramePending = false;
+				pass = 0;
+			}
+		}
+		else
+		{
+			pass = tracer.traceProgressive(frameCamera, settings.traceDepth, Color(0, 0, 0), Color(0, 0, 0), frames->getBackBuffer());
+
+			if (!tracer.wasCancelled()) frames->publish();
+		}
+
+		lock.lock();
+
+		if (tracer.wasCancelled())
+		{
+			++stats.cancelledFrames;
+		}
+		else if (pass == 0)
+		{
+			addFrameStats(frameCamera.getVersion(), frameCameraTime);
+		}
+	}
+}
+
+
+inline void RenderService::addFrameStats(uint32_t cameraVersion, std::chrono::steady_clock::time_point requestTime)
+{
+	stats.firstPixelMs = elapsedMs(requestTime, tracer.getFirstTileTime());
+	stats.frameMs = elapsedMs(requestTime, std::chrono::steady_clock::now());
+	stats.maxFirstPixelMs = max(stats.maxFirstPixelMs, stats.firstPixelMs);
+	stats.maxFrameMs = max(stats.maxFrameMs, stats.frameMs);
+	stats.totalFirstPixelMs += stats.firstPixelMs;
+	stats.totalFrameMs += stats.frameMs;
+	stats.cameraVersion = cameraVersion;
+	++stats.frames;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stdint.h>
+
+
+// Comment out to compile every counter away
+#define USE_RENDER_STATS
+
+
+// Work done by one trace, counted by every render thread on its own and merged when the frame ends
+struct RenderStats
+{
+	uint64_t cameraRays = 0;			// including the unshaded G-buffer rays
+	uint64_t reflectionRays = 0;
+	uint64_t refractionRays = 0;
+	uint64_t diffuseRays = 0;			// monte carlo samples of USE_MC_REFLECT
+	uint64_t shadowRays = 0;
+
+	uint64_t primitiveTests = 0;		// ray against sphere, triangle or plane, packet rays count once per lane
+	uint64_t nodeVisits = 0;			// BVH nodes popped by traversal, object and light BVH, packets count once per lane reaching the node
+	uint64_t nearestLightCalls = 0;
+
+	int maxDepth = 0;					// deepest bounce traced, 1 for camera ray
+
+	uint64_t getRays() const
+	{
+		return cameraRays + reflectionRays + refractionRays + diffuseRays + shadowRays;
+	}
+
+	void merge(const RenderStats &other)
+	{
+		cameraRays += other.cameraRays;
+		reflectionRays += other.reflectionRays;
+		refractionRays += other.refractionRays;
+		diffuseRays += other.diffuseRays;
+		shadowRays += other.shadowRays;
+
+		primitiveTests += other.primitiveTests;
+		nodeVisits += other.nodeVisits;
+		nearestLightCalls += other.nearestLightCalls;
+
+		maxDepth = maxDepth > other.maxDepth ? maxDepth : other.maxDepth;
+	}
+};
+
+
+#ifdef USE_RENDER_STATS
+
+// Counters of calling thread, no other thread touches them while it renders
+inline RenderStats &threadRenderStats()
+{
+	thread_local static RenderStats stats;
+	return stats;
+}
+
+#define RENDER_STAT_ADD(counter, n) (threadRenderStats().counter += (n))
+#define RENDER_STAT_MAX(counter, n) \
+	do { RenderStats &stats_ = threadRenderStats(); if ((n) > stats_.counter) stats_.counter = (n); } while (0)
+
+#else
+
+#define RENDER_STAT_ADD(counter, n) ((void)0)
+#define RENDER_STAT_MAX(counter, n) ((void)0)
+
+#endif // USE_RENDER_STATS
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "vec.h"
+#include <stdint.h>
+
+
+// Dimensions taken from the scrambled sobol sequence, later dimensions of a sample use the PCG stream
+#define SAMPLER_SOBOL_DIMENSIONS 16
+
+
+// PCG32 (XSH RR), small state and good statistical quality, every stream is independent
+class Pcg32
+{
+public:
+	Pcg32()
+	{
+		seed(0, 0);
+	}
+
+	void seed(uint64_t initState, uint64_t stream)
+	{
+		state = 0;
+		increment = (stream << 1) | 1;
+		nextUint();
+		state += initState;
+		nextUint();
+	}
+
+	uint32_t nextUint()
+	{
+		uint64_t old = state;
+		state = old * 6364136223846793005ull + increment;
+
+		uint32_t xorShifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		uint32_t rot = (uint32_t)(old >> 59);
+
+		return (xorShifted >> rot) | (xorShifted << ((0u - rot) & 31));
+	}
+
+	// Uniform in [0, 1)
+	float nextFloat()
+	{
+		return (nextUint() >> 8) * (1.0f / 16777216.0f);
+	}
+
+private:
+	uint64_t state;
+	uint64_t increment;
+};
+
+
+/*
+	Random numbers of one sample, a pure function of (pixel, sample index), so every thread
+	can own a sampler and images do not depend on thread count or scheduling.
+
+	Dimensions are consumed in call order. The first SAMPLER_SOBOL_DIMENSIONS come from the
+	2D sobol (0, 2) sequence indexed by sample index shuffled per dimension, owen scrambled per
+	pixel and dimension, so samples of one pixel stratify each other. The rest come from a PCG stream.
+*/
+class Sampler
+{
+public:
+	// Start sample sampleIndex of pixel, dimensions restart from 0
+	void startSample(uint32_t pixel, uint32_t sampleIndex)
+	{
+		startPixel = pixel;
+		startIndex = sampleIndex;
+		dimension = 0;
+		sobolDimensions = SAMPLER_SOBOL_DIMENSIONS;
+
+		rng.seed(hash(pixel ^ hash(sampleIndex)), pixel);
+	}
+
+	// Start a stream without sobol part, for rays only identified by a counter such as wavefront slots
+	void startStream(uint32_t pixel, uint32_t counter)
+	{
+		startSample(pixel, counter);
+		sobolDimensions = 0;
+	}
+
+	float get1D()
+	{
+		if (dimension >= sobolDimensions)
+		{
+			++dimension;
+			return rng.nextFloat();
+		}
+
+		uint32_t scramble = hash(startPixel ^ hash(dimension + 0x9e3779b9u));
+		++dimension;
+
+		return toFloat(owenScramble(reverseBits(shuffleIndex(scramble)), scramble));
+	}
+
+	void get2D(float &u, float &v)
+	{
+		if (dimension >= sobolDimensions)
+		{
+			++dimension;
+			u = rng.nextFloat();
+			v = rng.nextFloat();
+			return;
+		}
+
+		uint32_t scramble = hash(startPixel ^ hash(dimension + 0x9e3779b9u));
+		uint32_t index = shuffleIndex(scramble);
+		++dimension;
+
+		u = toFloat(owenScramble(reverseBits(index), scramble));
+		v = toFloat(owenScramble(sobolSecond(index), hash(scramble)));
+	}
+
+	static uint32_t hash(uint32_t x)
+	{
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+		return x;
+	}
+
+private:
+	static uint32_t reverseBits(uint32_t x)
+	{
+		x = (x << 16) | (x >> 16);
+		x = ((x & 0x00ff00ffu) << 8) | ((x & 0xff00ff00u) >> 8);
+		x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+		x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+		x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+		return x;
+	}
+
+	// Second dimension of sobol sequence, as a 32 bit fraction
+	static uint32_t sobolSecond(uint32_t index)
+	{
+		uint32_t result = 0;
+
+		for (uint32_t direction = 1u << 31; index != 0; index >>= 1, direction ^= direction >> 1)
+		{
+			if (index & 1) result ^= direction;
+		}
+
+		return result;
+	}
+
+	// Laine-Karras hash, every bit is flipped depending only on the bits above it like owen scrambling
+	static uint32_t owenScramble(uint32_t x, uint32_t scramble)
+	{
+		x = reverseBits(x);
+		x += scramble;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return reverseBits(x);
+	}
+
+	// Sample index in a different order for every dimension, otherwise all pairs of a sample would take the
+	// same point of the net and be correlated. The nested scramble only permutes index inside aligned power of 2
+	// blocks, so the first 2^k samples of a pixel are still a stratified (0, 2) net in every pair
+	uint32_t shuffleIndex(uint32_t scramble) const
+	{
+		return owenScramble(startIndex, hash(scramble ^ 0x68e31da4u));
+	}
+
+	static float toFloat(uint32_t x)
+	{
+		return (x >> 8) * (1.0f / 16777216.0f);
+	}
+
+	uint32_t startPixel = 0;
+	uint32_t startIndex = 0;
+	uint32_t dimension = 0;
+	uint32_t sobolDimensions = 0;
+	Pcg32 rng;
+};
+
+
+// Unit vector at cosAngle to unit vector axis, turned by 2 * PI * u around it
+inline Vec3 coneDirection(const Vec3 &axis, float cosAngle, float u)
+{
+	// any vector not parallel to axis gives the frame
+	Vec3 helper = fabsf(axis.x) > 0.9f ? Vec3(0, 1, 0) : Vec3(1, 0, 0);
+	Vec3 tangent = axis.xmul(helper);
+	tangent.normalize();
+	Vec3 bitangent = axis.xmul(tangent);
+
+	float sinAngle = sqrtf(max(1.0f - cosAngle * cosAngle, 0.0f));
+	float phi = 2.0f * PI * u;
+
+	Vec3 direct = axis * cosAngle + (tangent * cosf(phi) + bitangent * sinf(phi)) * sinAngle;
+	direct.normalize();
+
+	return direct;
+}
@@ -2,68 +2,242 @@
 
 #include "light.h"
 #include "object.h"
-#include "kdTree.h"
+#include "bvh.h"
+#include "lightTree.h"
+#include "triangleBlock.h"
+#include "indexedMesh.h"
+#include "arena.h"
 #include <vector>
+#include <algorithm>
 #include <cmath>
 
+/*
+	Scence owns everything added to it. Objects and lights are copied into arenas and released together with the scence.
+	Every primitive type has its own arena, so objects of one type are packed together in insertion order.
+
+	Between frames objects can be moved through their setters, added and removed, then update() refits the object BVH instead of building it again.
+*/
 class Scence
 {
 public:
 	Scence() {};
 	~Scence() 
 	{
-		// TODO
+		clear();
 	};
 
-	void addLight(VolumnLight *vlight)
+	Scence(const Scence &) = delete;
+	Scence &operator=(const Scence &) = delete;
+
+	template <typename LightType>
+	LightType *addLight(const LightType &light)
 	{
-		AABB *box = new AABB();
-		box->data = vlight;
-		vlight->calcAABB(*box);
+		LightType *vlight = lightArena.create<LightType>(light);
 
 		vlightsRaw.push_back(vlight);
-		vlights.push_back(box);
+
+		return vlight;
 	}
 
-	void addPlane(Plane *plane) 
+	template <typename PlaneType>
+	PlaneType *addPlane(const PlaneType &plane) 
 	{
-		objectsRaw.push_back(plane);
-		planes.push_back(plane);
+		PlaneType *object = planeArena.create<PlaneType>(plane);
+
+		objectsRaw.push_back(object);
+
+		if (object->getType() == OBJECT_CHEESE_PLANE)
+		{
+			cheesePlanes.push_back(static_cast<CheesePlane *>(static_cast<Plane *>(object)));
+		}
+		else
+		{
+			planes.push_back(object);
+		}
+
+		return object;
+	}
+
+	Triangle *addTriangle(const Triangle &triangle)
+	{
+		Triangle *object = triangleArena.create<Triangle>(triangle);
+
+		objectsRaw.push_back(object);
+		boundedObjects.push_back(object);
+
+		return object;
 	}
 
-	void addTriangle(Triangle *triangle)
+	template <typename SphereType>
+	SphereType *addSphere(const SphereType &sphere)
 	{
-		AABB *box = new AABB();
-		box->data = triangle;
-		triangle->calcAABB(*box);
+		SphereType *object = sphereArena.create<SphereType>(sphere);
 
-		objectsRaw.push_back(triangle);
+		objectsRaw.push_back(object);
+		boundedObjects.push_back(object);
 
-		objects.push_back(box);
+		return object;
 	}
 
-	void addSphere(Sphere *sphere)
+	// All triangles of mesh share one material, degenerate triangles are skipped
+	// Return the number of triangles added
+	size_t addMesh(const IndexedMesh &mesh, const Color &reflectionRatio, const Color &refractionRatio, float refractionEta, float diffuseFactor)
 	{
-		AABB *box = new AABB();
-		box->data = sphere;
-		sphere->calcAABB(*box);
+		size_t added = 0;
+
+		objectsRaw.reserve(objectsRaw.size() + mesh.getTriangleCount());
+		boundedObjects.reserve(boundedObjects.size() + mesh.getTriangleCount());
+
+		for (size_t i = 0; i < mesh.getTriangleCount(); ++i)
+		{
+			Point3 pointA = mesh.getVertex(mesh.indices[i * 3]);
+			Point3 pointB = mesh.getVertex(mesh.indices[i * 3 + 1]);
+			Point3 pointC = mesh.getVertex(mesh.indices[i * 3 + 2]);
+
+			if ((pointB - pointA).xmul(pointC - pointA).length() <= 0.0f) continue;
 
-		objectsRaw.push_back(sphere);
+			Triangle *triangle = triangleArena.create<Triangle>(pointA, pointB, pointC, reflectionRatio, refractionRatio, refractionEta, diffuseFactor);
 
-		objects.push_back(box);
+			objectsRaw.push_back(triangle);
+			boundedObjects.push_back(triangle);
+			++added;
+		}
+
+		return added;
 	}
 
-	void ray_query_vlights(const Point3 &point, const Vec3 &direct, std::unordered_set<void *> &result)
+	// Remove object, rays still see it until the next build() or update(), its memory is kept until clear()
+	void removeObject(Object *object)
 	{
-		result.clear();
-		vlightTree->ray_query(point, direct, result);
+		objectsRaw.erase(std::remove(objectsRaw.begin(), objectsRaw.end(), object), objectsRaw.end());
+
+		if (object->getType() == OBJECT_PLANE)
+		{
+			planes.erase(std::remove(planes.begin(), planes.end(), object), planes.end());
+			return;
+		}
+
+		if (object->getType() == OBJECT_CHEESE_PLANE)
+		{
+			cheesePlanes.erase(std::remove(cheesePlanes.begin(), cheesePlanes.end(), object), cheesePlanes.end());
+			return;
+		}
+
+		uint32_t slot = object->getSceneSlot();
+
+		if (slot < bvhObjects.size() && bvhObjects[slot] == object)
+		{
+			uint32_t index = objectBvh.getPrimitiveOrder()[slot];
+
+			boundedObjects[index] = nullptr;
+			removedObjects.push_back(index);
+			return;
+		}
+
+		// added after the last build() or update(), not in the BVH yet
+		auto it = std::find(boundedObjects.begin() + bvhObjectCount, boundedObjects.end(), object);
+		if (it != boundedObjects.end()) *it = nullptr;
 	}
 
-	void ray_query_objects(const Point3 &point, const Vec3 &direct, std::unordered_set<void *> &result)
+	// Subtrees of object BVH whose SAH cost grew past ratio times their cost when built are built again by update()
+	void setRebuildRatio(float ratio)
 	{
-		result.clear();
-		objectTree->ray_query(point, direct, result);
-		result.insert(planes.cbegin(), planes.cend());
+		rebuildRatio = ratio;
+	}
+
+	// Bring acceleration structures up to date with objects moved, added and removed since build() or the last update().
+	// BVH bounds are refit and only degraded subtrees are built again, lights are not updated
+	// Return number of BVH subtrees built again
+	int update()
+	{
+		std::vector<AABB> bounds(boundedObjects.size());
+		std::vector<uint32_t> added;
+		int objectCount = (int)boundedObjects.size();
+
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < objectCount; ++i)
+		{
+			if (boundedObjects[i] != nullptr) boundedObjects[i]->calcAABB(bounds[i]);
+		}
+
+		for (size_t i = bvhObjectCount; i < boundedObjects.size(); ++i)
+		{
+			if (boundedObjects[i] != nullptr) added.push_back((uint32_t)i);
+		}
+
+		int rebuilt = objectBvh.update(bounds, added, removedObjects, rebuildRatio);
+
+		removedObjects.clear();
+		bvhObjectCount = boundedObjects.size();
+
+		updateBvhSlots();
+
+		return rebuilt;
+	}
+
+	// Remove everything, arena memory is kept for the next scence built in this object
+	void clear()
+	{
+		lightBvh.clear();
+		lightTree.clear();
+		objectBvh.clear();
+		triangleBlock.clear();
+
+		vlightsRaw.clear();
+		bvhLights.clear();
+		objectsRaw.clear();
+		boundedObjects.clear();
+		bvhObjects.clear();
+		bvhObjectTypes.clear();
+		removedObjects.clear();
+		bvhObjectCount = 0;
+		planes.clear();
+		cheesePlanes.clear();
+
+		lightArena.reset();
+		triangleArena.reset();
+		sphereArena.reset();
+		planeArena.reset();
+	}
+
+	// Bytes held by the scence: arenas, acceleration structures and object lists
+	size_t getMemoryBytes() const
+	{
+		return lightArena.getReservedBytes() + triangleArena.getReservedBytes() + sphereArena.getReservedBytes() + planeArena.getReservedBytes() +
+			lightBvh.getMemoryBytes() + lightTree.getMemoryBytes() + objectBvh.getMemoryBytes() + triangleBlock.getMemoryBytes() + bvhObjectTypes.capacity() +
+			removedObjects.capacity() * sizeof(uint32_t) +
+			(vlightsRaw.capacity() + bvhLights.capacity() + objectsRaw.capacity() + boundedObjects.capacity() +
+			 bvhObjects.capacity() + planes.capacity() + cheesePlanes.capacity()) * sizeof(void *);
+	}
+
+	// Nearest light source hit by ray, lights are tested in place while the BVH is walked front to back
+	// Return NO_INTERSECTION if no light is hit, distance is negative if point is inside the light
+	float nearestLight(const Point3 &point, const Vec3 &direct, VolumnLight *&light) const
+	{
+		float nearest = FLT_MAX;
+
+		auto visitLeaf = [&](uint32_t first, uint32_t count, float &tMax)
+		{
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				float distance = bvhLights[i]->getIntersection(point, direct);
+
+				if (distance != NO_INTERSECTION && distance < nearest)
+				{
+					nearest = distance;
+					light = bvhLights[i];
+				}
+			}
+
+			// a light containing point is entered at 0, keep those nodes reachable
+			tMax = nearest > 0.0f ? nearest : 0.0f;
+			return false;
+		};
+
+		float tMax = FLT_MAX;
+		lightBvh.traverse(point, direct, tMax, visitLeaf);
+
+		return nearest == FLT_MAX ? NO_INTERSECTION : nearest;
 	}
 
 	const std::vector<VolumnLight *> & getAllLights() const
@@ -71,40 +245,218 @@ public:
 		return vlightsRaw;
 	}
 
+	// Importance sampling of lights for scences with many lights
+	const LightTree & getLightTree() const
+	{
+		return lightTree;
+	}
+
 	const std::vector<Object *> & getAllObjects() const
 	{
 		return objectsRaw;
 	}
 
-	void build()
+	// Objects with finite bound, in the primitive order of object BVH
+	const std::vector<Object *> & getBvhObjects() const
 	{
-		vlightTree = new KdTree(AABB(Point3(-100000, -100000, -100000), Point3(100000, 100000, 100000)), 2, 0, max(log2(vlights.size() / 2), 2));
-		objectTree = new KdTree(AABB(Point3(-100000, -100000, -100000), Point3(100000, 100000, 100000)), 5, 0, max(log2(objects.size() / 5), 2));
+		return bvhObjects;
+	}
+
+	// Type of every object of getBvhObjects(), inside a BVH leaf triangles come first
+	const std::vector<uint8_t> & getBvhObjectTypes() const
+	{
+		return bvhObjectTypes;
+	}
+
+	// Planes are unbounded and always tested outside the BVH, cheese planes are kept apart
+	const std::vector<Plane *> & getPlanes() const
+	{
+		return planes;
+	}
+
+	const std::vector<CheesePlane *> & getCheesePlanes() const
+	{
+		return cheesePlanes;
+	}
+
+	const Bvh & getObjectBvh() const
+	{
+		return objectBvh;
+	}
+
+	// Triangles of getBvhObjects() in SIMD friendly layout, indexed by the same slot
+	const TriangleBlock & getTriangleBlock() const
+	{
+		return triangleBlock;
+	}
+
+	// Any hit query for shadow ray, stop at the first object closer than tMax
+	// Return 0 if not blocked, -1 if only blocked by self while in medium, 1 if blocked by other object
+	int occluded(const Point3 &point, const Vec3 &direct, float tMax, const Object *self, bool isInMedium) const
+	{
+		int result = 0;
+
+		// in medium object never block itself, leave it to the scalar test
+		uint32_t selfSlot = isInMedium ? self->getSceneSlot() : NO_SCENE_SLOT;
 
-		for (auto vlight : vlights) 
+		auto visitLeaf = [&](uint32_t first, uint32_t count, float &)
 		{
-			vlightTree->insert(vlight);
+			RENDER_STAT_ADD(primitiveTests, count);
+
+			if (triangleBlock.occluded(first, count, point, direct, selfSlot, tMax))
+			{
+				result = 1;
+				return true;
+			}
+
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				int blocked;
+
+				if (bvhObjectTypes[i] == OBJECT_TRIANGLE)
+				{
+					if (i != selfSlot) continue;
+
+					blocked = occludedBy(static_cast<const Triangle *>(bvhObjects[i]), point, direct, tMax, self, isInMedium);
+				}
+				else
+				{
+					blocked = occludedBy(static_cast<const Sphere *>(bvhObjects[i]), point, direct, tMax, self, isInMedium);
+				}
+
+				if (blocked == 1)
+				{
+					result = 1;
+					return true;
+				}
+
+				if (blocked == -1) result = -1;
+			}
+
+			return false;
+		};
+
+		float bvhMax = tMax;
+		objectBvh.traverse(point, direct, bvhMax, visitLeaf);
+
+		if (result == 1) return 1;
+
+		for (auto plane : planes)
+		{
+			RENDER_STAT_ADD(primitiveTests, 1);
+
+			int blocked = occludedBy(plane, point, direct, tMax, self, isInMedium);
+
+			if (blocked == 1) return 1;
+			if (blocked == -1) result = -1;
 		}
 
-		for (auto object : objects)
+		for (auto plane : cheesePlanes)
 		{
-			objectTree->insert(object);
+			RENDER_STAT_ADD(primitiveTests, 1);
+
+			int blocked = occludedBy(static_cast<const Plane *>(plane), point, direct, tMax, self, isInMedium);
+
+			if (blocked == 1) return 1;
+			if (blocked == -1) result = -1;
 		}
+
+		return result;
 	}
 
-	
-	
+	void build()
+	{
+		std::vector<AABB> lightBounds(vlightsRaw.size());
+
+		for (size_t i = 0; i < vlightsRaw.size(); ++i)
+		{
+			vlightsRaw[i]->calcAABB(lightBounds[i]);
+		}
+
+		lightBvh.build(lightBounds);
+		lightTree.build(vlightsRaw);
+
+		const std::vector<uint32_t> &lightOrder = lightBvh.getPrimitiveOrder();
+		bvhLights.resize(lightOrder.size());
+
+		for (size_t i = 0; i < lightOrder.size(); ++i)
+		{
+			bvhLights[i] = vlightsRaw[lightOrder[i]];
+		}
+
+		// drop objects removed since the last build
+		boundedObjects.erase(std::remove(boundedObjects.begin(), boundedObjects.end(), nullptr), boundedObjects.end());
+		removedObjects.clear();
+		bvhObjectCount = boundedObjects.size();
+
+		std::vector<AABB> bounds(boundedObjects.size());
+
+		for (size_t i = 0; i < boundedObjects.size(); ++i)
+		{
+			boundedObjects[i]->calcAABB(bounds[i]);
+		}
+
+		objectBvh.build(bounds);
+
+		updateBvhSlots();
+	}
 
 private:
 
-	KdTree *vlightTree = nullptr;
-	KdTree *objectTree = nullptr;
+	// Store objects in leaf order so a leaf is a contiguous range of slots
+	void updateBvhSlots()
+	{
+		// group every leaf by type, so a leaf is a run of triangles followed by a run of spheres
+		objectBvh.sortLeaves([&](uint32_t a, uint32_t b)
+		{
+			return boundedObjects[a]->getType() < boundedObjects[b]->getType();
+		});
+
+		const std::vector<uint32_t> &order = objectBvh.getPrimitiveOrder();
+		bvhObjects.resize(order.size());
+		bvhObjectTypes.resize(order.size());
+
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			bvhObjects[i] = boundedObjects[order[i]];
+			bvhObjects[i]->setSceneSlot((uint32_t)i);
+			bvhObjectTypes[i] = bvhObjects[i]->getType();
+		}
+
+		triangleBlock.build(bvhObjects);
+	}
+
+	// PrimitiveType is a concrete type, its getIntersection is called without virtual dispatch
+	template <typename PrimitiveType>
+	static int occludedBy(const PrimitiveType *obj, const Point3 &point, const Vec3 &direct, float tMax, const Object *self, bool isInMedium)
+	{
+		float distance = obj->PrimitiveType::getIntersection(point, direct, isInMedium);
+
+		if (distance == NO_INTERSECTION || distance >= tMax) return 0;
+
+		return (isInMedium && obj == self) ? -1 : 1;
+	}
 
-	std::vector<AABB *> vlights;
+	Bvh lightBvh;
+	LightTree lightTree;
+	Bvh objectBvh;
+	TriangleBlock triangleBlock;
 
 	std::vector<VolumnLight *> vlightsRaw;
+	std::vector<VolumnLight *> bvhLights;		// lights in primitive order of light BVH
 	std::vector<Object *> objectsRaw;
 
-	std::vector<AABB *> objects;
+	std::vector<Object *> boundedObjects;		// index is primitive of object BVH, removed objects are nullptr until build()
+	size_t bvhObjectCount = 0;					// objects from here on were added after the last build() or update()
+	std::vector<uint32_t> removedObjects;
+	float rebuildRatio = BVH_REBUILD_RATIO;
+	std::vector<Object *> bvhObjects;
+	std::vector<uint8_t> bvhObjectTypes;
 	std::vector<Plane *> planes;
+	std::vector<CheesePlane *> cheesePlanes;
+
+	Arena lightArena;
+	Arena triangleArena;
+	Arena sphereArena;
+	Arena planeArena;
 };
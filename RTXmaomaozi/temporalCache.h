@@ -0,0 +1,110 @@
+#pragma once
+
+#include "camera.h"
+#include "gBuffer.h"
+#include "sampler.h"
+#include <vector>
+#include <memory>
+
+
+// Every frame 1 / TEMPORAL_REFRESH_PERIOD of the pixels is traced even if its color could be reused, so view dependent
+// shading seen by reused pixels is brought up to date within that many frames
+#define TEMPORAL_REFRESH_PERIOD 16
+// Reused pixel must have seen a point closer than this times the distance from view point
+#define TEMPORAL_POSITION_TOLERANCE 0.005f
+
+
+struct TemporalPixel
+{
+	TemporalPixel() : position(0, 0, 0), object(nullptr), light(nullptr), color(0, 0, 0)
+	{
+		;
+	}
+
+	Point3 position;				// first hit point
+	const Object *object;			// nullptr for background, which is never reused
+	const VolumnLight *light;
+	Color color;					// linear
+};
+
+
+/*
+	Last frame of Tracer::traceTemporal(): the first hit of every pixel and its color.
+	A pixel of the next frame projects its own first hit into the last camera, and keeps the color
+	of the pixel there if that pixel saw the same point of the same object.
+*/
+class TemporalCache
+{
+public:
+	void reset()
+	{
+		lastCamera.reset();
+		lastFrame.clear();
+	}
+
+	// Start a frame for camera
+	// Return false if there is no last frame of the same size to reuse
+	bool beginFrame(const Camera &camera)
+	{
+		int pixelCount = (int)camera.getWidth() * (int)camera.getHeight();
+
+		frame.resize(pixelCount);
+		++frameIndex;
+
+		return lastCamera && lastFrame.size() == (size_t)pixelCount;
+	}
+
+	// If pixel is traced this frame whatever the last frame saw, every pixel is once in TEMPORAL_REFRESH_PERIOD frames
+	bool isRefreshPixel(int pixel) const
+	{
+		return (Sampler::hash(pixel) + frameIndex) % TEMPORAL_REFRESH_PERIOD == 0;
+	}
+
+	// Color of the last frame for point seen by sample
+	// Return false if the pixel point projects to saw something else
+	bool lookup(const Point3 &point, const GBufferSample &sample, Color &color) const
+	{
+		float x, y;
+
+		if (!lastCamera->project(point, x, y)) return false;
+
+		int lastX = (int)floorf(x + 0.5f);
+		int lastY = (int)floorf(y + 0.5f);
+		int width = (int)lastCamera->getWidth();
+
+		if (lastX < 0 || lastY < 0 || lastX >= width || lastY >= (int)lastCamera->getHeight()) return false;
+
+		const TemporalPixel &last = lastFrame[lastX + lastY * width];
+
+		if (last.object != sample.object || last.light != sample.light) return false;
+
+		if ((last.position - point).length() > TEMPORAL_POSITION_TOLERANCE * (point - lastCamera->getViewPoint()).length()) return false;
+
+		color = last.color;
+
+		return true;
+	}
+
+	void store(int pixel, const Point3 &point, const GBufferSample &sample, const Color &color)
+	{
+		TemporalPixel &stored = frame[pixel];
+
+		stored.position = point;
+		stored.object = sample.object;
+		stored.light = sample.light;
+		stored.color = color;
+	}
+
+	// Frame stored since beginFrame() becomes the last frame
+	void endFrame(const Camera &camera)
+	{
+		lastCamera.reset(new Camera(camera));
+		lastFrame.swap(frame);
+	}
+
+private:
+	std::unique_ptr<Camera> lastCamera;
+	std::vector<TemporalPixel> lastFrame;
+	std::vector<TemporalPixel> frame;
+	uint32_t frameIndex = 0;
+};
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <algorithm>
+#include <stdint.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+#define TILE_MAX_THREADS 256
+
+
+struct Tile
+{
+	int x, y;			// top left pixel
+	int width, height;
+};
+
+
+/*
+	Split the image into tiles and hand them out to threads.
+
+	Tiles are sorted along Morton curve and cut into one contiguous range per thread,
+	so neighbouring tiles tend to be rendered by the same thread. A thread pops tiles
+	from the front of its own range, when it is empty it steals from the back of others.
+*/
+class TileScheduler
+{
+public:
+	TileScheduler() {}
+
+	TileScheduler(const TileScheduler &) = delete;
+	TileScheduler &operator=(const TileScheduler &) = delete;
+
+	void reset(int width, int height, int tileSize, int threadCount);
+
+	// Next tile for thread, false if every tile has been taken
+	bool next(int thread, Tile &tile);
+
+	int getThreadCount() const
+	{
+		return threadCount;
+	}
+
+	int getTileCount() const
+	{
+		return (int)tiles.size();
+	}
+
+	// Thread count to use when caller does not specify one
+	static int defaultThreadCount()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+private:
+	static uint32_t spreadBits(uint32_t v)
+	{
+		v &= 0xffff;
+		v = (v | (v << 8)) & 0x00ff00ff;
+		v = (v | (v << 4)) & 0x0f0f0f0f;
+		v = (v | (v << 2)) & 0x33333333;
+		v = (v | (v << 1)) & 0x55555555;
+		return v;
+	}
+
+	// [head, tail) of tiles owned by a thread, packed so both ends move with one CAS
+	struct alignas(64) TileRange
+	{
+		std::atomic<uint64_t> range;
+	};
+
+	static uint64_t packRange(uint32_t head, uint32_t tail)
+	{
+		return ((uint64_t)tail << 32) | head;
+	}
+
+	std::vector<Tile> tiles;
+	TileRange ranges[TILE_MAX_THREADS];
+	int threadCount = 0;
+};
+
+
+inline void TileScheduler::reset(int width, int height, int tileSize, int threadCount)
+{
+	this->threadCount = min(max(threadCount, 1), TILE_MAX_THREADS);
+
+	int tilesX = (width + tileSize - 1) / tileSize;
+	int tilesY = (height + tileSize - 1) / tileSize;
+
+	std::vector<std::pair<uint32_t, Tile>> order;
+	order.reserve(tilesX * tilesY);
+
+	for (int ty = 0; ty < tilesY; ++ty)
+	{
+		for (int tx = 0; tx < tilesX; ++tx)
+		{
+			Tile tile;
+			tile.x = tx * tileSize;
+			tile.y = ty * tileSize;
+			tile.width = min(tileSize, width - tile.x);
+			tile.height = min(tileSize, height - tile.y);
+
+			order.push_back(std::make_pair(spreadBits(tx) | (spreadBits(ty) << 1), tile));
+		}
+	}
+
+	std::sort(order.begin(), order.end(), [](const std::pair<uint32_t, Tile> &lhs, const std::pair<uint32_t, Tile> &rhs)
+	{
+		return lhs.first < rhs.first;
+	});
+
+	tiles.resize(order.size());
+
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		tiles[i] = order[i].second;
+	}
+
+	uint32_t tileCount = (uint32_t)tiles.size();
+
+	for (int i = 0; i < this->threadCount; ++i)
+	{
+		uint32_t head = (uint32_t)((uint64_t)tileCount * i / this->threadCount);
+		uint32_t tail = (uint32_t)((uint64_t)tileCount * (i + 1) / this->threadCount);
+
+		ranges[i].range.store(packRange(head, tail), std::memory_order_relaxed);
+	}
+}
+
+
+inline bool TileScheduler::next(int thread, Tile &tile)
+{
+	// own range first, from the front
+	std::atomic<uint64_t> &own = ranges[thread].range;
+	uint64_t value = own.load(std::memory_order_acquire);
+
+	while ((uint32_t)value < (uint32_t)(value >> 32))
+	{
+		if (own.compare_exchange_weak(value, value + 1, std::memory_order_acq_rel))
+		{
+			tile = tiles[(uint32_t)value];
+			return true;
+		}
+	}
+
+	// then steal from the back of other threads
+	for (int i = 1; i < threadCount; ++i)
+	{
+		std::atomic<uint64_t> &victim = ranges[(thread + i) % threadCount].range;
+		value = victim.load(std::memory_order_acquire);
+
+		while ((uint32_t)value < (uint32_t)(value >> 32))
+		{
+			uint32_t tail = (uint32_t)(value >> 32) - 1;
+
+			if (victim.compare_exchange_weak(value, packRange((uint32_t)value, tail), std::memory_order_acq_rel))
+			{
+				tile = tiles[tail];
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
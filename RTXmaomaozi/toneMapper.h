@@ -0,0 +1,147 @@
+#pragma once
+
+#include "hdrFrame.h"
+#include <vector>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+
+// Gamma table entries per unit of Color, 8 bit output of 255 * 16 steps keeps dark gradients smooth
+#define TONE_GAMMA_STEPS 16
+
+
+enum ToneOperator
+{
+	TONE_CLAMP,			// values above white are cut, same as Color::getColor()
+	TONE_REINHARD,		// x / (1 + x) of x = value / 255, bright highlights keep their color
+};
+
+
+struct ToneSettings
+{
+	float exposure = 1.0f;		// scale of linear value before tone operator
+	ToneOperator op = TONE_CLAMP;
+	float gamma = 1.0f;			// output is value ^ (1 / gamma), the scene colors are tuned for 1
+};
+
+
+/*
+	Pass from linear HdrFrame to packed 8 bit bitmap, 4 pixels of a row at a time with SSE.
+	Exposure, tone operator and clamp run on the float planes, then the channels are truncated and packed.
+	With gamma other than 1 the clamped value indexes a table instead, since SSE has no pow.
+	Default settings give the same bitmap as Color::getColor() of every pixel.
+*/
+class ToneMapper
+{
+public:
+	void setSettings(const ToneSettings &settings);
+
+	const ToneSettings &getSettings() const
+	{
+		return settings;
+	}
+
+	// Rows of bitmap are bottom up like frame, or top down as shown on screen
+	void map(const HdrFrame &frame, UINT32 *bitmap, bool isTopDown, int threadCount) const;
+
+private:
+	// Clamped display value of 4 pixels of one channel
+	__m128 toneChannel(const float *plane) const
+	{
+		__m128 value = _mm_mul_ps(_mm_loadu_ps(plane), _mm_set1_ps(settings.exposure));
+
+		if (settings.op == TONE_REINHARD)
+		{
+			// 255 * x / (1 + x) with x = value / 255
+			value = _mm_div_ps(_mm_mul_ps(value, _mm_set1_ps(255.0f)), _mm_add_ps(value, _mm_set1_ps(255.0f)));
+		}
+
+		// NaN becomes white like in getColor()
+		return _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(255.0f)), _mm_setzero_ps());
+	}
+
+	void mapBlock(const HdrFrame &frame, int first, UINT32 *pixels) const;
+
+	ToneSettings settings;
+	std::vector<uint8_t> gammaTable;
+};
+
+
+inline void ToneMapper::setSettings(const ToneSettings &newSettings)
+{
+	settings = newSettings;
+	gammaTable.clear();
+
+	if (settings.gamma == 1.0f) return;
+
+	gammaTable.resize(255 * TONE_GAMMA_STEPS + 1);
+
+	for (size_t i = 0; i < gammaTable.size(); ++i)
+	{
+		float value = (float)i / (255 * TONE_GAMMA_STEPS);
+		gammaTable[i] = (uint8_t)(255.0f * powf(value, 1.0f / settings.gamma) + 0.5f);
+	}
+}
+
+
+inline void ToneMapper::map(const HdrFrame &frame, UINT32 *bitmap, bool isTopDown, int threadCount) const
+{
+	int width = frame.getWidth();
+	int height = frame.getHeight();
+	int fullBlocks = width / 4;
+
+#pragma omp parallel for schedule(static) num_threads(threadCount)
+	for (int y = 0; y < height; ++y)
+	{
+		int first = y * width;
+		UINT32 *row = &bitmap[(isTopDown ? height - 1 - y : y) * width];
+
+		for (int block = 0; block < fullBlocks; ++block)
+		{
+			mapBlock(frame, first + block * 4, &row[block * 4]);
+		}
+
+		// the next row or padding of the planes lets the last block be mapped whole
+		if (fullBlocks * 4 < width)
+		{
+			UINT32 last[4];
+			mapBlock(frame, first + fullBlocks * 4, last);
+
+			memcpy(&row[fullBlocks * 4], last, sizeof(UINT32) * (width - fullBlocks * 4));
+		}
+	}
+}
+
+
+inline void ToneMapper::mapBlock(const HdrFrame &frame, int first, UINT32 *pixels) const
+{
+	__m128 r = toneChannel(frame.getPlane(0) + first);
+	__m128 g = toneChannel(frame.getPlane(1) + first);
+	__m128 b = toneChannel(frame.getPlane(2) + first);
+
+	if (gammaTable.empty())
+	{
+		__m128i packed = _mm_or_si128(_mm_or_si128(
+			_mm_slli_epi32(_mm_cvttps_epi32(r), 16),
+			_mm_slli_epi32(_mm_cvttps_epi32(g), 8)),
+			_mm_cvttps_epi32(b));
+
+		_mm_storeu_si128((__m128i *)pixels, packed);
+		return;
+	}
+
+	__m128 steps = _mm_set1_ps((float)TONE_GAMMA_STEPS);
+	alignas(16) int32_t index[3][4];
+
+	_mm_store_si128((__m128i *)index[0], _mm_cvttps_epi32(_mm_mul_ps(r, steps)));
+	_mm_store_si128((__m128i *)index[1], _mm_cvttps_epi32(_mm_mul_ps(g, steps)));
+	_mm_store_si128((__m128i *)index[2], _mm_cvttps_epi32(_mm_mul_ps(b, steps)));
+
+	for (int i = 0; i < 4; ++i)
+	{
+		pixels[i] = ((UINT32)gammaTable[index[0][i]] << 16) | ((UINT32)gammaTable[index[1][i]] << 8) | gammaTable[index[2][i]];
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "vec.h"
+#include "color.h"
+#include "object.h"
+
+
+// Enough for trace depth 16 with monte-carlo diffuse, deeper work is dropped like a ray reaching max depth
+#define TRACE_STACK_SIZE 128
+
+
+enum TraceTaskType
+{
+	TRACE_RAY,			// find nearest object of ray and shade it
+	DIRECT_LIGHT,		// direct lighting of a hit point, run after its child rays like the old recursion
+	DIFFUSE_SAMPLE		// spawn monte-carlo diffuse rays of a hit point
+};
+
+
+/*
+	Pending work of one camera ray. Every task carry the product of all ratios between it
+	and the camera, so its result can be added to the pixel directly.
+*/
+struct TraceTask
+{
+	TraceTask() : point(0, 0, 0), direct(0, 0, 0), weight(0, 0, 0)
+	{
+		;
+	}
+
+	TraceTaskType type;
+
+	Point3 point;		// ray origin, or hit point for DIRECT_LIGHT and DIFFUSE_SAMPLE
+	Vec3 direct;		// ray direction, or main reflection direction for DIRECT_LIGHT and DIFFUSE_SAMPLE
+	Color weight;
+
+	Object *obj;		// object ray emit from, or object being hit for DIRECT_LIGHT and DIFFUSE_SAMPLE
+	int depth;
+	bool isInMedium;
+};
+
+
+class TraceStack
+{
+public:
+	TraceStack() : size(0)
+	{
+		;
+	}
+
+	TraceStack(const TraceStack &) = delete;
+	TraceStack &operator=(const TraceStack &) = delete;
+
+	bool isEmpty() const
+	{
+		return size == 0;
+	}
+
+	void clear()
+	{
+		size = 0;
+	}
+
+	// Return nullptr when stack is full
+	TraceTask *push()
+	{
+		if (size == TRACE_STACK_SIZE) return nullptr;
+
+		return &tasks[size++];
+	}
+
+	TraceTask pop()
+	{
+		return tasks[--size];
+	}
+
+private:
+	TraceTask tasks[TRACE_STACK_SIZE];
+	int size;
+};
@@ -5,11 +5,32 @@
 #include "light.h"
 #include "camera.h"
 #include "scence.h"
+#include "tileScheduler.h"
+#include "traceStack.h"
+#include "wavefront.h"
+#include "sampler.h"
+#include "adaptiveSampling.h"
+#include "gBuffer.h"
+#include "temporalCache.h"
+#include "renderStats.h"
+#include "pixelCost.h"
+#include "hdrFrame.h"
+#include "toneMapper.h"
 
 
 //#define USE_MC_REFLECT
 #define FASTER_RENDER
-//#define USE_KD_TREE
+#define USE_BVH
+#define USE_RAY_PACKET		// trace camera rays of one pixel as packet, need USE_BVH
+
+
+// Wall time of the phases of one trace()
+struct TracePhaseTimes
+{
+	double tilesMs = 0;			// trace and shade every tile into the linear frame
+	double tonemapMs = 0;		// linear frame to bitmap
+};
+
 
 class Tracer
 {
@@ -30,20 +51,18 @@ private:
 		// Check if any object between lightSource and emitPoint
 		// If there is something, return true
 
-		int result = 0;	// no shadowed
-
-#ifdef USE_KD_TREE
-		thread_local static std::unordered_set<void *> filter_objects;
-		scence->ray_query_objects(intersection.intersectionPoint, lightDirection, filter_objects);
+		RENDER_STAT_ADD(shadowRays, 1);
 
-		for (auto objIter : filter_objects)
+#ifdef USE_BVH
+		return scence->occluded(intersection.intersectionPoint, lightDirection, lightDistance, intersection.obj, isInMedium);
 #else
+		int result = 0;	// no shadowed
+
 		for (auto objIter : scence->getAllObjects())
-#endif // USE_KD_TREE
 		{
 			// if any object block this light source, in medium will not block by medium itself 
 			Object *obj = (Object *)objIter;
-			float distance = obj->getIntersection(intersection.intersectionPoint, lightDirection, isInMedium);
+			float distance = ObjectDispatch::getIntersection(obj, intersection.intersectionPoint, lightDirection, isInMedium);
 
 			if (distance != NO_INTERSECTION && distance < lightDistance)
 			{
@@ -61,6 +80,7 @@ private:
 
 		// can reach light source direct
 		return result;
+#endif // USE_BVH
 	}
 
 
@@ -71,28 +91,79 @@ private:
 		float firstIntersectionDistance = FLT_MAX;		// The most near intersection distance
 		bool isFound = false;							// If we got any intersection
 
-#ifdef USE_KD_TREE
-		thread_local static std::unordered_set<void *> filter_objects;
-		scence->ray_query_objects(emitPoint, rayVec, filter_objects);
-		for (auto objIter : filter_objects)
+		const std::vector<Object *> &bvhObjects = scence->getBvhObjects();
+		const std::vector<uint8_t> &bvhObjectTypes = scence->getBvhObjectTypes();
+		const TriangleBlock &triangles = scence->getTriangleBlock();
+
+		uint32_t skipSlot = (!isInMedium && castObj != nullptr) ? castObj->getSceneSlot() : NO_SCENE_SLOT;
+
+		auto visitLeaf = [&](uint32_t first, uint32_t count, float &tMax)
+		{
+			RENDER_STAT_ADD(primitiveTests, count);
+
+			int slot = triangles.intersect(first, count, emitPoint, rayVec, skipSlot, tMax);
+
+			if (slot >= 0)
+			{
+				isFound = true;
+				firstIntersection.obj = bvhObjects[slot];
+			}
+
+			// triangles lead the leaf and are done by the kernel, the rest are spheres
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				if (bvhObjectTypes[i] == OBJECT_TRIANGLE) continue;
+
+				Object *obj = bvhObjects[i];
+				float intersectionDistance = static_cast<const Sphere *>(obj)->Sphere::getIntersection(emitPoint, rayVec, isInMedium);
+
+				if (intersectionDistance > 0 && intersectionDistance < tMax && (isInMedium || castObj != obj))
+				{
+					isFound = true;
+					tMax = intersectionDistance;
+
+					firstIntersection.obj = obj;
+				}
+			}
+
+			return false;
+		};
+
+#ifdef USE_BVH
+		scence->getObjectBvh().traverse(emitPoint, rayVec, firstIntersectionDistance, visitLeaf);
 #else
-		for (auto objIter : scence->getAllObjects())
+		visitLeaf(0, (uint32_t)bvhObjects.size(), firstIntersectionDistance);
 #endif
-		{
-			// Get all intersection and then calculate distance
 
-			Object *obj = (Object *)objIter;
+		if (isFound)
+		{
+			firstIntersection.intersectionPoint = emitPoint + rayVec * firstIntersectionDistance;
+		}
 
-			float intersectionDistance = obj->getIntersection(emitPoint, rayVec, isInMedium);
+		auto visitPlane = [&](Plane *plane)
+		{
+			float intersectionDistance = plane->Plane::getIntersection(emitPoint, rayVec, isInMedium);
 
-			if (intersectionDistance > 0 && intersectionDistance < firstIntersectionDistance && (isInMedium || castObj != objIter))
+			if (intersectionDistance > 0 && intersectionDistance < firstIntersectionDistance && (isInMedium || castObj != plane))
 			{
 				isFound = true;
 				firstIntersectionDistance = intersectionDistance;
 
 				firstIntersection.intersectionPoint = emitPoint + rayVec * intersectionDistance;
-				firstIntersection.obj = obj;
+				firstIntersection.obj = plane;
 			}
+		};
+
+		RENDER_STAT_ADD(primitiveTests, scence->getPlanes().size() + scence->getCheesePlanes().size());
+
+		for (auto plane : scence->getPlanes())
+		{
+			visitPlane(plane);
+		}
+
+		for (auto plane : scence->getCheesePlanes())
+		{
+			visitPlane(plane);
 		}
 
 		if (isFound)
@@ -106,21 +177,118 @@ private:
 	}
 
 
+#ifdef USE_RAY_PACKET
+	// Nearest object for every active lane of a camera ray packet, share one BVH traversal for the whole packet
+	void getNearestObjectPacket(const RayPacket &packet, float *distance, Intersection *firstIntersection)
+	{
+		alignas(16) float tMax[RAY_PACKET_SIZE];
+
+		for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+		{
+			tMax[lane] = (packet.activeMask & (1 << lane)) ? FLT_MAX : -1.0f;
+		}
+
+		const std::vector<Object *> &bvhObjects = scence->getBvhObjects();
+		const std::vector<uint8_t> &bvhObjectTypes = scence->getBvhObjectTypes();
+		const TriangleBlock &triangles = scence->getTriangleBlock();
+
+		scence->getObjectBvh().traversePacket(packet, tMax, [&](uint32_t first, uint32_t count, int mask, float *tMax)
+		{
+			float laneDistance[RAY_PACKET_SIZE];
+
+#ifdef USE_RENDER_STATS
+			for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+			{
+				if (mask & (1 << lane)) RENDER_STAT_ADD(primitiveTests, count);
+			}
+#endif
+
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				Object *obj = bvhObjects[i];
+
+				if (bvhObjectTypes[i] == OBJECT_TRIANGLE)
+				{
+					triangles.intersectPacket(i, packet, mask, laneDistance);
+				}
+				else
+				{
+					const Sphere *sphere = static_cast<const Sphere *>(obj);
+
+					for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+					{
+						laneDistance[lane] = (mask & (1 << lane)) ? sphere->Sphere::getIntersection(packet.getOrigin(lane), packet.getDirect(lane), false) : NO_INTERSECTION;
+					}
+				}
+
+				for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+				{
+					if (laneDistance[lane] > 0 && laneDistance[lane] < tMax[lane])
+					{
+						tMax[lane] = laneDistance[lane];
+						firstIntersection[lane].obj = obj;
+					}
+				}
+			}
+		});
+
+		for (int lane = 0; lane < RAY_PACKET_SIZE; ++lane)
+		{
+			if (!(packet.activeMask & (1 << lane))) continue;
+
+			Point3 emitPoint = packet.getOrigin(lane);
+			Vec3 rayVec = packet.getDirect(lane);
+
+			RENDER_STAT_ADD(primitiveTests, scence->getPlanes().size() + scence->getCheesePlanes().size());
+
+			auto visitPlane = [&](Plane *plane)
+			{
+				float intersectionDistance = plane->Plane::getIntersection(emitPoint, rayVec, false);
+
+				if (intersectionDistance > 0 && intersectionDistance < tMax[lane])
+				{
+					tMax[lane] = intersectionDistance;
+					firstIntersection[lane].obj = plane;
+				}
+			};
+
+			for (auto plane : scence->getPlanes())
+			{
+				visitPlane(plane);
+			}
+
+			for (auto plane : scence->getCheesePlanes())
+			{
+				visitPlane(plane);
+			}
+
+			if (tMax[lane] != FLT_MAX)
+			{
+				distance[lane] = tMax[lane];
+				firstIntersection[lane].intersectionPoint = emitPoint + rayVec * tMax[lane];
+			}
+			else
+			{
+				distance[lane] = NO_INTERSECTION;
+			}
+		}
+	}
+#endif // USE_RAY_PACKET
+
+
 	float getNearestLight(const Point3 &emitPoint, const Vec3 &rayVec, VolumnLight *&light)
 	{
 		// rayDirect is always normalized
 
+		RENDER_STAT_ADD(nearestLightCalls, 1);
+
+#ifdef USE_BVH
+		return scence->nearestLight(emitPoint, rayVec, light);
+#else
 		float firstIntersectionDistance = FLT_MAX;		// The most near intersection distance
 		bool isFound = false;							// If we got any intersection
 
-#ifdef USE_KD_TREE
-		thread_local static std::unordered_set<void *> filter_lights;
-		scence->ray_query_vlights(emitPoint, rayVec, filter_lights);
-
-		for (auto lightIter : filter_lights)
-#else
 		for (auto vLight : scence->getAllLights())
-#endif
 		{
 			// Get all intersection and then calculate distance
 			float intersectionDistance = vLight->getIntersection(emitPoint, rayVec);
@@ -141,6 +309,7 @@ private:
 		{
 			return NO_INTERSECTION;
 		}
+#endif // USE_BVH
 	}
 
 
@@ -148,124 +317,247 @@ private:
 	{
 
 		Vec3 normVector(0, 0, 0);
-		intersection.obj->getNormVecAt(intersection.intersectionPoint, normVector);
+		ObjectDispatch::getNormVecAt(intersection.obj, intersection.intersectionPoint, normVector);
+
+		int lightSamples = getLightSampleCount();
 
-		for (auto lightIter : scence->getAllLights())
+		for (int sample = 0; sample < lightSamples; ++sample)
 		{
-			Color lightBuffer(0, 0, 0);
+			float lightWeight;
+			VolumnLight *vLight = pickLight(intersection.intersectionPoint, sample, lightWeight);
 
-			VolumnLight *vLight =(VolumnLight *)lightIter;
+			if (vLight == nullptr) continue;
 
-			int sampleTime = 1;
+			// Only process direct reflactor(illuminate by light source)
+			float u, v;
+			threadSampler().get2D(u, v);
 
 			Vec3 lightDirection(0, 0, 0);
+			float ratio;
+			float lightSourceDistance = vLight->sampleRayVec(intersection.intersectionPoint, u, v, lightDirection, ratio);
 
-			Vec3 lightCenterDirection = vLight->position - intersection.intersectionPoint;
-			lightCenterDirection.normalize();
+			int shadowState = isShadow(lightDirection, lightSourceDistance, intersection, isInMedium);
 
-			for (int i = 0; i < sampleTime; ++i)
+			if (shadowState <= 0 )
 			{
-				// Only process direct reflactor(illuminate by light source)
-				float ratio;
-				float lightSourceDistance = vLight->sampleRayVec(intersection.intersectionPoint, lightDirection, ratio);
+				accumulateLightColor += lightSampleColor(vLight, intersection, normVector, lightDirection, lightSourceDistance, ratio * lightWeight);
+			}
+		}
+
+		accumulateLightColor += ambientLight;
+	}
 
-				int shadowState = isShadow(lightDirection, lightSourceDistance, intersection, isInMedium);
 
-				if (shadowState <= 0 )
-				{
-					Color lightColor = vLight->getLightStrength(lightDirection, lightSourceDistance, normVector);
-					lightColor *= intersection.obj->getDiffuseFactor() * normVector.dot(lightDirection);
+	// Every light is sampled once per hit point, unless there are enough lights for the light tree
+	int getLightSampleCount() const
+	{
+		int lightCount = (int)scence->getAllLights().size();
 
-					lightBuffer += lightColor * ratio;
+		return lightCount > LIGHT_TREE_MIN_LIGHTS ? LIGHT_TREE_SAMPLES : lightCount;
+	}
 
-				}
-			}
-			lightBuffer /= sampleTime;
+	// Light for one of the getLightSampleCount() samples at point, weight divides by the probability it was picked
+	VolumnLight *pickLight(const Point3 &point, int sample, float &weight)
+	{
+		const std::vector<VolumnLight *> &lights = scence->getAllLights();
 
-			accumulateLightColor += lightBuffer;
+		if (lights.size() <= LIGHT_TREE_MIN_LIGHTS)
+		{
+			weight = 1.0f;
+			return lights[sample];
 		}
 
-		accumulateLightColor += ambientLight;
+		float pdf;
+		VolumnLight *vLight = scence->getLightTree().sample(point, threadSampler().get1D(), pdf);
+
+		weight = 1.0f / (pdf * LIGHT_TREE_SAMPLES);
+		return vLight;
 	}
 
 
-	inline void xorshift32(uint32_t &state)
+	// Diffuse light from a sampled point of light source, assume it is not shadowed
+	Color lightSampleColor(const VolumnLight *vLight, const Intersection &intersection, const Vec3 &normVector, const Vec3 &lightDirection, float lightSourceDistance, float ratio)
 	{
-		state ^= state << 13;
-		state ^= state >> 17;
-		state ^= state << 5;
-	}
+		Color lightColor = vLight->getLightStrength(lightDirection, lightSourceDistance, normVector);
+		lightColor *= intersection.obj->getDiffuseFactor() * normVector.dot(lightDirection);
 
-	inline uint32_t fastrand(uint32_t &state) {
-		state = (214013 * state + 2531011);
-		return state;
+		return lightColor * ratio;
 	}
 
 
+	// Sampler of calling thread, restarted by startSample() for every camera ray
+	static Sampler &threadSampler()
+	{
+		thread_local static Sampler sampler;
+		return sampler;
+	}
+
+	static Sampler &startSample(uint32_t pixel, uint32_t sampleIndex)
+	{
+		Sampler &sampler = threadSampler();
+		sampler.startSample(pixel, sampleIndex);
+		return sampler;
+	}
 
-	void deffuseMonteCarlo(const Intersection &intersection, const Vec3 &rayVec,  bool isInMedium, int nowDepth, Color &reflectionColor)
+	static Sampler &startStream(uint32_t pixel, uint32_t counter)
 	{
-		
-		Color diffuseColor(0, 0, 0);
-		Vec3 p(0, 0, 0);
-		Vec3 norm(0, 0, 0);
+		Sampler &sampler = threadSampler();
+		sampler.startStream(pixel, counter);
+		return sampler;
+	}
+
 
-		intersection.obj->getNormVecAt(intersection.intersectionPoint, norm);
+	void deffuseMonteCarlo(const TraceTask &task, TraceStack &stack)
+	{
+		// samples are pushed in reverse so they are traced in the order they are generated
+		const int sampleTime = 5;
+		Vec3 sampleDirect[sampleTime] = { Vec3(0, 0, 0), Vec3(0, 0, 0), Vec3(0, 0, 0), Vec3(0, 0, 0), Vec3(0, 0, 0) };
 
-		float rayVecDot = rayVec * rayVec;
-		float rayVecLength = rayVec.length();
+		Vec3 rayVec = task.direct;
+		rayVec.normalize();
 
-		int sampleTime = 5;
-		
-		uint32_t state = rand();
+		Sampler &sampler = threadSampler();
 
 		for (int i = 0; i < sampleTime; ++i) {
-			float targetCosAngle = 1.0f - (fastrand(state) / 2147483647.5f) * intersection.obj->getDiffuseFactor();
+			float u, v;
+			sampler.get2D(u, v);
+
+			// cosine to main reflection spreads over [1 - 2 * diffuse, 1]
+			float targetCosAngle = 1.0f - 2.0f * u * task.obj->getDiffuseFactor();
+
+			sampleDirect[i] = coneDirection(rayVec, targetCosAngle, v);
+		}
+
+		for (int i = sampleTime - 1; i >= 0; --i)
+		{
+			if (pushRay(stack, task.point, sampleDirect[i], task.obj, task.isInMedium, task.depth - 2, task.weight / (float)sampleTime)) RENDER_STAT_ADD(diffuseRays, 1);
+		}
+	}
 
-			// vector create referer to https://math.stackexchange.com/questions/2464998/random-vector-with-fixed-angle
 
-			p.x = 1.0f - fastrand(state) / 2147483647.5f;
-			p.y = 1.0f - fastrand(state) / 2147483647.5f;
-			p.z = 1.0f - fastrand(state) / 2147483647.5f;
+	// Return false if ray is dropped
+	bool pushRay(TraceStack &stack, const Point3 &emitPoint, const Vec3 &rayDirect, Object *emitObject, bool rayInMedium, int nowDepth, const Color &weight)
+	{
+		if (nowDepth <= 0) return false;
+
+		// full stack only happens far beyond usual trace depth, drop the ray as if it reach max depth
+		TraceTask *task = stack.push();
+		if (task == nullptr) return false;
 
+		task->type = TRACE_RAY;
+		task->point = emitPoint;
+		task->direct = rayDirect;
+		task->weight = weight;
+		task->obj = emitObject;
+		task->depth = nowDepth;
+		task->isInMedium = rayInMedium;
 
-			p -= rayVec * ((p * rayVec) / rayVecDot);
+		return true;
+	}
 
-			p /= p.length();
-			p *= rayVecLength;
 
-			Vec3 v = rayVec * targetCosAngle;
-			p *= sqrtf(1.0f - targetCosAngle * targetCosAngle);
-			v += p;
+	void pushHitTask(TraceStack &stack, TraceTaskType type, const Intersection &intersection, const Vec3 &reflectionDirect, bool rayInMedium, int nowDepth, const Color &weight)
+	{
+		TraceTask *task = stack.push();
+		if (task == nullptr) return;
+
+		task->type = type;
+		task->point = intersection.intersectionPoint;
+		task->direct = reflectionDirect;
+		task->weight = weight;
+		task->obj = intersection.obj;
+		task->depth = nowDepth;
+		task->isInMedium = rayInMedium;
+	}
 
-			castTraceRay(intersection.intersectionPoint, v, intersection.obj, isInMedium, nowDepth - 2, diffuseColor);
 
-		}
+	// Run all pending tasks and add their light on color parameter
+	void runTraceStack(TraceStack &stack, Color &light)
+	{
+		while (!stack.isEmpty())
+		{
+			TraceTask task = stack.pop();
+
+			if (task.type == TRACE_RAY)
+			{
+				RENDER_STAT_MAX(maxDepth, traceDepth - task.depth + 1);
+
+				Intersection nearestObjectIntersection;
+				float objDistance = getNearestObject(task.point, task.direct, task.isInMedium, task.obj, nearestObjectIntersection);
+
+				shadeHit(stack, task.point, task.direct, task.obj, task.isInMedium, task.depth, objDistance, nearestObjectIntersection, task.weight, light);
+			}
+			else if (task.type == DIRECT_LIGHT)
+			{
+				// The diffuse part (only diffuse light to reduce calculation)
+				Color directColor(0, 0, 0);
+				directLightColour(Intersection(task.point, task.obj), task.direct, task.isInMedium, directColor);
 
-		reflectionColor += diffuseColor / sampleTime;
+				light += directColor * task.weight;
+			}
+			else
+			{
+				deffuseMonteCarlo(task, stack);
+			}
+		}
 	}
 
 
 	// Cast a ray to object and add the light of it on color parameter
 	void castTraceRay(const Point3 &emitPoint, const Vec3 &rayDirect, Object *emitObject, bool rayInMedium, int nowDepth, Color &light)
 	{
-		/* 
-		Step 1:	
-			Determine if depth reach max trace depth
-		*/
-		if (nowDepth <= 0)
+		thread_local static TraceStack stack;
+
+		RENDER_STAT_ADD(cameraRays, 1);
+
+		stack.clear();
+		pushRay(stack, emitPoint, rayDirect, emitObject, rayInMedium, nowDepth, Color(1, 1, 1));
+
+		runTraceStack(stack, light);
+	}
+
+
+	// First object and light hit by camera ray, without shading
+	void primaryHit(const Point3 &viewPoint, const Vec3 &rayDirect, GBufferSample &sample)
+	{
+		RENDER_STAT_ADD(cameraRays, 1);
+
+		Intersection intersection;
+		float objDistance = getNearestObject(viewPoint, rayDirect, false, nullptr, intersection);
+
+		VolumnLight *light = nullptr;
+		float lightDistance = getNearestLight(viewPoint, rayDirect, light);
+
+		bool isLightFirst = lightDistance != NO_INTERSECTION && (objDistance == NO_INTERSECTION || objDistance > lightDistance);
+
+		sample.light = isLightFirst ? light : nullptr;
+		sample.object = objDistance == NO_INTERSECTION ? nullptr : intersection.obj;
+		sample.depth = objDistance;
+
+		if (sample.object != nullptr)
 		{
-			return;		// Stop iter
+			ObjectDispatch::getNormVecAt(sample.object, intersection.intersectionPoint, sample.normal);
 		}
+	}
 
-		/*
-		Step 2:
-			Check if intersect with light source can direct illuminate the surface
-		*/
-		Intersection nearestObjectIntersection;
-		float objDistance = getNearestObject(emitPoint, rayDirect, rayInMedium, emitObject, nearestObjectIntersection);
 
+	// Same as castTraceRay, but nearest object of the ray is already known, the ray is counted by whoever found it
+	void shadeRay(const Point3 &emitPoint, const Vec3 &rayDirect, Object *emitObject, bool rayInMedium, int nowDepth, float objDistance, const Intersection &nearestObjectIntersection, Color &light)
+	{
+		thread_local static TraceStack stack;
+
+		RENDER_STAT_MAX(maxDepth, 1);
+
+		stack.clear();
+		shadeHit(stack, emitPoint, rayDirect, emitObject, rayInMedium, nowDepth, objDistance, nearestObjectIntersection, Color(1, 1, 1), light);
 
+		runTraceStack(stack, light);
+	}
+
+
+	// Add light reaching the hit point directly, and push the rays and lighting that depend on it
+	void shadeHit(TraceStack &stack, const Point3 &emitPoint, const Vec3 &rayDirect, Object *emitObject, bool rayInMedium, int nowDepth, float objDistance, const Intersection &nearestObjectIntersection, const Color &weight, Color &light)
+	{
 		//Check if intersect with light source can direct illuminate the surface
 		VolumnLight *nearestLightSource;
 
@@ -274,7 +566,7 @@ private:
 
 		if (lightDistance != NO_INTERSECTION && (objDistance == NO_INTERSECTION || objDistance > lightDistance))
 		{
-			light += nearestLightSource->getLightStrength(rayDirect, lightDistance, rayDirect);
+			light += nearestLightSource->getLightStrength(rayDirect, lightDistance, rayDirect) * weight;
 		}
 
 		// See though background
@@ -282,7 +574,7 @@ private:
 		{
 			if (lightDistance == NO_INTERSECTION)
 			{
-				light += backgroundColor;
+				light += backgroundColor * weight;
 				return;
 			}
 			else
@@ -291,69 +583,54 @@ private:
 			}
 		}
 
+		/*
+			Tasks are pushed in reverse, so refraction ray is traced first, then reflection,
+			then direct lighting, same order as the recursion used to consume sample dimensions
+		*/
+
+		const Point3 &hitPoint = nearestObjectIntersection.intersectionPoint;
+		Object *hitObject = nearestObjectIntersection.obj;
+
 		/*
 		Step 3:	
-			Process refraction, calculate refraction ray and recursion trace
+			Process refraction, calculate refraction ray
 			If total reflection happend, no need to calculate refraction
 		*/
 		bool totalReflection = false;
+		Vec3 refractionRayDirect(0, 0, 0);
 
-		if (nearestObjectIntersection.obj->getRefractionRatio(nearestObjectIntersection.intersectionPoint).getStrength() >= 0.1f) {
-			Vec3 refractionRayDirect(0, 0, 0);
-			totalReflection = nearestObjectIntersection.obj->calcRefractionRay(nearestObjectIntersection.intersectionPoint, rayDirect, rayInMedium, refractionRayDirect);
-
-			if (!totalReflection)
-			{
-				// Calculate refraction
-				Color refractionColor(0, 0, 0);
-				castTraceRay(nearestObjectIntersection.intersectionPoint, refractionRayDirect, nearestObjectIntersection.obj, !rayInMedium, nowDepth - 1, refractionColor);
-
-				refractionColor *= nearestObjectIntersection.obj->getRefractionRatio(nearestObjectIntersection.intersectionPoint);
-
-				light += refractionColor;
-			}
+		if (ObjectDispatch::getRefractionRatio(hitObject, hitPoint).getStrength() >= 0.1f) {
+			totalReflection = ObjectDispatch::calcRefractionRay(hitObject, hitPoint, rayDirect, rayInMedium, refractionRayDirect);
 		}
 
 		/*
 		Step 4:
-			Calculate all reflection ray and recursion trace
+			Calculate all reflection ray
 		*/
 		Vec3 mainReflectionRayDirect(0, 0, 0);
-		nearestObjectIntersection.obj->calcReflectionRay(nearestObjectIntersection.intersectionPoint, rayDirect, mainReflectionRayDirect);
+		ObjectDispatch::calcReflectionRay(hitObject, hitPoint, rayDirect, mainReflectionRayDirect);
+
+		Color reflectionWeight = weight * (totalReflection ? ObjectDispatch::getTotalReflectionRatio(hitObject, hitPoint) : ObjectDispatch::getReflectionRatio(hitObject, hitPoint));
 
-		Color reflectionColor(0, 0, 0);
+		pushHitTask(stack, DIRECT_LIGHT, nearestObjectIntersection, mainReflectionRayDirect, rayInMedium, nowDepth, reflectionWeight);
 
 #ifdef USE_MC_REFLECT
-		if (nowDepth >= traceDepth - 5 && (emitObject == NULL || emitObject->getDiffuseFactor() <= 0.01f) && nearestObjectIntersection.obj->getDiffuseFactor() >= 0.01f)
+		if (nowDepth >= traceDepth - 5 && (emitObject == NULL || emitObject->getDiffuseFactor() <= 0.01f) && hitObject->getDiffuseFactor() >= 0.01f)
 		{
 			// Use accurate monte-carlo reflect model simulation of diffuse
-			deffuseMonteCarlo(nearestObjectIntersection, mainReflectionRayDirect, rayInMedium, nowDepth, reflectionColor);
+			pushHitTask(stack, DIFFUSE_SAMPLE, nearestObjectIntersection, mainReflectionRayDirect, rayInMedium, nowDepth, reflectionWeight);
 		}
 		else
 #endif
 		{
-			// The direct reflect part
-			castTraceRay(nearestObjectIntersection.intersectionPoint, mainReflectionRayDirect, nearestObjectIntersection.obj, rayInMedium, nowDepth - 1, reflectionColor);
-
-			// If object is diffuse, direct reflector will have less weight
-			reflectionColor *= (1 - nearestObjectIntersection.obj->getDiffuseFactor());
-
+			// The direct reflect part, if object is diffuse, direct reflector will have less weight
+			if (pushRay(stack, hitPoint, mainReflectionRayDirect, hitObject, rayInMedium, nowDepth - 1, reflectionWeight * (1 - hitObject->getDiffuseFactor()))) RENDER_STAT_ADD(reflectionRays, 1);
 		}
 
-		// The diffuse part (only diffuse light to reduce calculation)
-		directLightColour(nearestObjectIntersection, mainReflectionRayDirect, rayInMedium, reflectionColor);
-
-
-		if (totalReflection)
-		{
-			reflectionColor *= nearestObjectIntersection.obj->getTotalReflectionRatio(nearestObjectIntersection.intersectionPoint);
-		}
-		else
+		if (ObjectDispatch::getRefractionRatio(hitObject, hitPoint).getStrength() >= 0.1f && !totalReflection)
 		{
-			reflectionColor *= nearestObjectIntersection.obj->getReflectionRatio(nearestObjectIntersection.intersectionPoint);
+			if (pushRay(stack, hitPoint, refractionRayDirect, hitObject, !rayInMedium, nowDepth - 1, weight * ObjectDispatch::getRefractionRatio(hitObject, hitPoint))) RENDER_STAT_ADD(refractionRays, 1);
 		}
-
-		light += reflectionColor;
 	}
 
 public:
@@ -363,8 +640,12 @@ public:
 		scence = newScence;
 	}
 
-	void renderPixel(int x, int y, const Camera &camera, UINT32 *pixel)
+	// Linear color of pixel
+	// primary is the first hit of the ray through pixel corner if the caller already cast it, then it is shaded from there
+	Color renderPixel(int x, int y, const Camera &camera, const GBufferSample *primary = nullptr)
 	{
+		uint32_t pixelIndex = x + y * camera.getWidth();
+
 		Vec3 nowViewRay = camera.getViewRay(x, y);
 		Vec3 nextViewRayX = camera.getViewRay(x + 1, y);
 		Vec3 nextViewRayY = camera.getViewRay(x, y + 1);
@@ -375,119 +656,1163 @@ public:
 
 		Color buffer(0, 0, 0);
 
+		int subRayCount = antiAliasScale * antiAliasScale;
+		int firstSubRay = 0;
+
+		// first sub pixel ray is the one through pixel corner
+		if (primary != nullptr && traceDepth > 0)
+		{
+			Intersection intersection(camera.getViewPoint() + nowViewRay * primary->depth, const_cast<Object *>(primary->object));
+
+			startSample(pixelIndex, 0);
+			shadeRay(camera.getViewPoint(), nowViewRay, nullptr, false, traceDepth, primary->depth, intersection, buffer);
+			firstSubRay = 1;
+		}
+
 		// calculate sub pixel for anti-alias
-		for (int subY = 0; subY < antiAliasScale; ++subY)
+#ifdef USE_RAY_PACKET
+		// sub pixel rays are coherent, find their first intersection as packets and shade each of them alone
+		for (int packetStart = firstSubRay; packetStart < subRayCount && traceDepth > 0; packetStart += RAY_PACKET_SIZE)
 		{
-			for (int subX = 0; subX < antiAliasScale; ++subX)
+			RayPacket packet;
+			int laneCount = min(RAY_PACKET_SIZE, subRayCount - packetStart);
+
+			for (int lane = 0; lane < laneCount; ++lane)
+			{
+				int subY = (packetStart + lane) / antiAliasScale;
+				int subX = (packetStart + lane) % antiAliasScale;
+
+				packet.setRay(lane, camera.getViewPoint(), nowViewRay + diffY * subY + diffX * subX);
+			}
+
+			float objDistance[RAY_PACKET_SIZE];
+			Intersection nearestObjectIntersection[RAY_PACKET_SIZE];
+
+			getNearestObjectPacket(packet, objDistance, nearestObjectIntersection);
+
+			for (int lane = 0; lane < laneCount; ++lane)
 			{
-				castTraceRay(camera.getViewPoint(), nowViewRay + diffY * subY + diffX * subX, nullptr, false, traceDepth, buffer);
+				RENDER_STAT_ADD(cameraRays, 1);
+
+				startSample(pixelIndex, packetStart + lane);
+				shadeRay(camera.getViewPoint(), packet.getDirect(lane), nullptr, false, traceDepth, objDistance[lane], nearestObjectIntersection[lane], buffer);
 			}
 		}
+#else
+		for (int subRay = firstSubRay; subRay < subRayCount; ++subRay)
+		{
+			int subY = subRay / antiAliasScale;
+			int subX = subRay % antiAliasScale;
+
+			startSample(pixelIndex, subRay);
+			castTraceRay(camera.getViewPoint(), nowViewRay + diffY * subY + diffX * subX, nullptr, false, traceDepth, buffer);
+		}
+#endif
 
 		buffer /= (float)(antiAliasScale * antiAliasScale);
-		*pixel = buffer.getColor();
+		return buffer;
 	}
 
 
-	void trace(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, int antiAliasScale, UINT32 *bitmap)
+	// Width and height of a render tile in pixel, rounded up to multiple of 4 with FASTER_RENDER
+	void setTileSize(int size)
 	{
-		this->backgroundColor = backgroundColor;
-		this->ambientLight = ambientLight;
-		this->traceDepth = traceDepth;
-		this->antiAliasScale = antiAliasScale;
+		tileSize = max(size, 1);
+	}
 
-		// calculate color of each pixel
+	// 0 means use all available threads
+	void setThreadCount(int count)
+	{
+		threadCount = max(count, 0);
+	}
 
-		int w = camera.getWidth();
-		int h = camera.getHeight();
+	// Tile based traces stop taking tiles once flag is set, tiles already started are finished. nullptr for none
+	void setCancelFlag(const std::atomic<bool> *flag)
+	{
+		cancelFlag = flag;
+	}
 
-#pragma omp parallel
-		{
+	// If the last tile based trace was cancelled before it took its last tile, bitmap is then left as it was
+	// since tiles not taken hold no pixels of this frame
+	bool wasCancelled() const
+	{
+		return cancelled;
+	}
 
-#pragma omp for nowait schedule(static, 2)
-#ifndef FASTER_RENDER
+	// When a thread finished the first tile of the last tile based trace, the first of its pixels are written
+	std::chrono::steady_clock::time_point getFirstTileTime() const
+	{
+		return firstTileTime;
+	}
 
-			for (int y = 0; y < h; ++y)
-			{
-				for (int x = 0; x < w; ++x)
-				{
-					renderPixel(x, y, camera, &bitmap[x + y * w]);
-				}
-			}
-#else
-			for (int y = 0; y < h; y += 4)
-			{
-				for (int x = 0; x < w; x += 4)
-				{
-					renderPixel(x, y, camera, &bitmap[x + y * w]);
-				}
-			}
+	// Counters of the last tile based trace, traceAdaptive() or traceWavefront(), all zero without USE_RENDER_STATS
+	const RenderStats &getRenderStats() const
+	{
+		return renderStats;
+	}
 
-			for (int space = 2; space >= 1; --space)
-			{
-#pragma omp barrier
-#pragma omp for nowait schedule(static, 2)
-				for (int y = 0; y < h - space - 1; y += space)
-				{
-					for (int x = 0; x < w - space - 1; x += space)
-					{
+	// Record cost of every pixel in trace(), PIXEL_COST_NONE to stop
+	void setPixelCostMetric(PixelCostMetric metric)
+	{
+		pixelCostMetric = metric;
+	}
 
-						int colorLhs = 0x000000;
-						int colorRhs = 0xffffff;
-
-						if (y % (space << 1) == 0 && x % (space << 1) != 0)
-						{
-							colorLhs = bitmap[(x - space) + y * w];
-							colorRhs = bitmap[(x + space) + y * w];
-						}
-						else if (y % (space << 1) != 0 && x % (space << 1) == 0)
-						{
-							colorLhs = bitmap[x + (y - space) * w];
-							colorRhs = bitmap[x + (y + space) * w];
-						}
-						else if (y % (space << 1) != 0 && x % (space << 1) != 0)
-						{
-							//colorLhs = bitmap[(x - space) + y * w];
-							//colorRhs = bitmap[x + (y - space) * w];
-						}
-						else
-						{
-							continue;
-						}
-
-						int lr = (colorLhs & 0xff0000) >> 16;
-						int lg = (colorLhs & 0x00ff00) >> 8;
-						int lb = (colorLhs & 0x0000ff);
-
-						int rr = (colorRhs & 0xff0000) >> 16;
-						int rg = (colorRhs & 0x00ff00) >> 8;
-						int rb = (colorRhs & 0x0000ff);
-
-						int rDiff = abs(lr - rr);
-						int gDiff = abs(lg - rg);
-						int bDiff = abs(lb - rb);
-
-						if (rDiff + gDiff + bDiff < 10)
-						{
-							bitmap[x + y * w] = Color((lr + rr) >> 1, (lg + rg) >> 1, (lb + rb) >> 1).getColor();
-						}
-						else
-						{
-							renderPixel(x, y, camera, &bitmap[x + y * w]);
-						}
-					}
-				}
-			}
-#endif
-		}
+	// Cost of every pixel of the last trace() with a metric set, empty otherwise
+	// With FASTER_RENDER the unshaded ray of a pixel counts, tile border pixels traced again by the tile before are not
+	const std::vector<uint64_t> &getPixelCosts() const
+	{
+		return pixelCosts;
 	}
 
-private:
-	int traceDepth;
-	int antiAliasScale;
+	// Exposure, tone operator and gamma of the pass from linear frame to bitmap at the end of every trace
+	void setToneSettings(const ToneSettings &settings)
+	{
+		toneMapper.setSettings(settings);
+	}
 
-	Color ambientLight;
-	Color backgroundColor;
+	const ToneSettings &getToneSettings() const
+	{
+		return toneMapper.getSettings();
+	}
+
+	// Linear frame of the last trace, bitmap is this frame after tone mapping
+	const HdrFrame &getHdrFrame() const
+	{
+		return frame;
+	}
+
+	// Rows of every bitmap written, bottom up by default, top down as shown for a presenter that copies it as is
+	void setBitmapTopDown(bool isTopDown)
+	{
+		isBitmapTopDown = isTopDown;
+	}
+
+	// Tone map the last frame again into bitmap, for new tone settings without tracing
+	void tonemap(UINT32 *bitmap) const
+	{
+		toneMapper.map(frame, bitmap, isBitmapTopDown, getWavefrontThreads());
+	}
+
+	// Phases of the last trace()
+	const TracePhaseTimes &getPhaseTimes() const
+	{
+		return phaseTimes;
+	}
+
+	// Camera rays cast by the last trace(), the unshaded G-buffer ray of FASTER_RENDER interpolated pixels is not counted
+	// and neither are tile border pixels traced again by the tile before, so pixels are counted once
+	uint64_t getCameraRayCount() const
+	{
+		return cameraRayCount;
+	}
+
+	// Return counters of the frame, see getRenderStats()
+	RenderStats trace(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, int antiAliasScale, UINT32 *bitmap)
+	{
+		this->backgroundColor = backgroundColor;
+		this->ambientLight = ambientLight;
+		this->traceDepth = traceDepth;
+		this->antiAliasScale = antiAliasScale;
+
+		// calculate color of each pixel
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+
+#ifdef FASTER_RENDER
+		int size = (tileSize + 3) & ~3;
+#else
+		int size = tileSize;
+#endif
+
+		cameraRayCount = 0;
+		renderStats = RenderStats();
+
+		if (pixelCostMetric != PIXEL_COST_NONE)
+		{
+			pixelCosts.assign(w * h, 0);
+		}
+		else
+		{
+			pixelCosts.clear();
+		}
+
+		frame.resize(w, h);
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		forEachTile(w, h, size, [&](const Tile &tile)
+		{
+			renderTile(tile, camera);
+		});
+
+		phaseTimes.tilesMs = lapMs(start);
+
+		if (!cancelled) tonemap(bitmap);
+
+		phaseTimes.tonemapMs = lapMs(start);
+
+		return renderStats;
+	}
+
+	// Add one jittered sample per pixel to the accumulation buffer and write the running average to bitmap
+	// Accumulation restarts when camera or image size changes, return samples per pixel so far
+	int traceProgressive(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, UINT32 *bitmap)
+	{
+		this->backgroundColor = backgroundColor;
+		this->ambientLight = ambientLight;
+		this->traceDepth = traceDepth;
+		this->antiAliasScale = 1;
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+
+		if (progressivePass == 0 || camera.getVersion() != progressiveCameraVersion || accumulation.size() != (size_t)(w * h))
+		{
+			accumulation.assign(w * h, Color(0, 0, 0));
+			progressivePass = 0;
+			progressiveCameraVersion = camera.getVersion();
+		}
+
+		cameraRayCount = 0;
+		renderStats = RenderStats();
+
+		frame.resize(w, h);
+
+		forEachTile(w, h, tileSize, [&](const Tile &tile)
+		{
+			accumulateTile(tile, camera);
+		});
+
+		// some pixels got this pass and some did not, start over
+		if (cancelled)
+		{
+			progressivePass = 0;
+			return 0;
+		}
+
+		tonemap(bitmap);
+
+		return ++progressivePass;
+	}
+
+	// Drop accumulated samples, next traceProgressive() starts from a new image
+	void resetProgressive()
+	{
+		progressivePass = 0;
+	}
+
+	// Reproject the last frame of traceTemporal() to camera. Every pixel casts one unshaded ray, keeps the color of the
+	// last frame if a pixel there saw the same point, and is traced if it was hidden before or is due for refresh.
+	// Call resetTemporal() after the scence changes. Return number of pixels traced
+	int traceTemporal(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, int antiAliasScale, UINT32 *bitmap)
+	{
+		this->backgroundColor = backgroundColor;
+		this->ambientLight = ambientLight;
+		this->traceDepth = traceDepth;
+		this->antiAliasScale = antiAliasScale;
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+
+		bool canReuse = temporalCache.beginFrame(camera);
+		std::atomic<int> tracedPixel{ 0 };
+
+		renderStats = RenderStats();
+		frame.resize(w, h);
+
+		forEachTile(w, h, tileSize, [&](const Tile &tile)
+		{
+			int traced = 0;
+
+			for (int y = tile.y; y < tile.y + tile.height; ++y)
+			{
+				for (int x = tile.x; x < tile.x + tile.width; ++x)
+				{
+					int pixel = x + y * w;
+					Vec3 viewRay = camera.getViewRay(x, y);
+
+					GBufferSample sample;
+					primaryHit(camera.getViewPoint(), viewRay, sample);
+
+					Point3 hitPoint = camera.getViewPoint() + viewRay * (sample.object != nullptr ? sample.depth : 0.0f);
+					Color color;
+					bool isReused = canReuse && sample.object != nullptr && !temporalCache.isRefreshPixel(pixel) &&
+						temporalCache.lookup(hitPoint, sample, color);
+
+					if (!isReused)
+					{
+						color = renderPixel(x, y, camera, &sample);
+						++traced;
+					}
+
+					frame.set(pixel, color);
+					temporalCache.store(pixel, hitPoint, sample, color);
+				}
+			}
+
+			tracedPixel += traced;
+		});
+
+		// keep the last complete frame to reuse
+		if (!cancelled)
+		{
+			temporalCache.endFrame(camera);
+			tonemap(bitmap);
+		}
+		cameraRayCount = (uint64_t)tracedPixel * antiAliasScale * antiAliasScale;
+
+		return tracedPixel;
+	}
+
+	// Next traceTemporal() traces every pixel
+	void resetTemporal()
+	{
+		temporalCache.reset();
+	}
+
+	void setAdaptiveSettings(const AdaptiveSettings &settings)
+	{
+		adaptiveSettings = settings;
+	}
+
+	const AdaptiveSettings &getAdaptiveSettings() const
+	{
+		return adaptiveSettings;
+	}
+
+	// Every pixel gets minSamples jittered samples, then rounds of ADAPTIVE_BATCH more go to pixels whose
+	// error is still above threshold until maxSamples. When a round does not fit the remaining budget
+	// the noisiest pixels get it. Return samples cast, 0 without tracing if the budget is below two samples per pixel
+	uint64_t traceAdaptive(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, UINT32 *bitmap)
+	{
+		this->backgroundColor = backgroundColor;
+		this->ambientLight = ambientLight;
+		this->traceDepth = traceDepth;
+		this->antiAliasScale = 1;
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+		int pixelCount = w * h;
+		int threads = threadCount > 0 ? threadCount : TileScheduler::defaultThreadCount();
+
+		// variance needs two samples, a budget that can not pay for them is rejected rather than exceeded
+		int minSamples = max(adaptiveSettings.minSamples, 2);
+		int maxSamples = max(adaptiveSettings.maxSamples, minSamples);
+		uint64_t budget = adaptiveSettings.sampleBudget;
+
+		if (budget > 0)
+		{
+			if (budget < (uint64_t)pixelCount * 2)
+			{
+				pixelEstimates.clear();
+				cameraRayCount = 0;
+				return 0;
+			}
+
+			minSamples = (int)min((uint64_t)minSamples, budget / pixelCount);
+		}
+
+		pixelEstimates.assign(pixelCount, PixelEstimate());
+		cameraRayCount = 0;
+		renderStats = RenderStats();
+
+		forEachTile(w, h, tileSize, [&](const Tile &tile)
+		{
+			for (int y = tile.y; y < tile.y + tile.height; ++y)
+			{
+				for (int x = tile.x; x < tile.x + tile.width; ++x)
+				{
+					addPixelSamples(x + y * w, minSamples, camera);
+				}
+			}
+
+			cameraRayCount += (uint64_t)tile.width * tile.height * minSamples;
+		});
+
+		uint64_t samples = cameraRayCount;
+
+		if (cancelled) return samples;
+
+		for (;;)
+		{
+			adaptivePixels.clear();
+
+			for (int i = 0; i < pixelCount; ++i)
+			{
+				const PixelEstimate &estimate = pixelEstimates[i];
+
+				if (estimate.count < maxSamples && estimate.getRelativeError() > adaptiveSettings.threshold) adaptivePixels.push_back(i);
+			}
+
+			if (budget > 0)
+			{
+				size_t roundPixels = budget > samples ? (size_t)((budget - samples) / ADAPTIVE_BATCH) : 0;
+
+				if (roundPixels < adaptivePixels.size())
+				{
+					// ties broken by index, so the chosen pixels depend on nothing but the estimates
+					std::nth_element(adaptivePixels.begin(), adaptivePixels.begin() + roundPixels, adaptivePixels.end(), [this](int a, int b)
+					{
+						float errorA = pixelEstimates[a].getRelativeError();
+						float errorB = pixelEstimates[b].getRelativeError();
+
+						return errorA > errorB || (errorA == errorB && a < b);
+					});
+
+					adaptivePixels.resize(roundPixels);
+				}
+			}
+
+			if (adaptivePixels.empty()) break;
+
+			int activeCount = (int)adaptivePixels.size();
+
+			for (int i = 0; i < activeCount; ++i)
+			{
+				samples += min(ADAPTIVE_BATCH, maxSamples - pixelEstimates[adaptivePixels[i]].count);
+			}
+
+#pragma omp parallel num_threads(threads)
+			{
+				beginThreadStats();
+
+#pragma omp for schedule(dynamic, 16)
+				for (int i = 0; i < activeCount; ++i)
+				{
+					int pixel = adaptivePixels[i];
+
+					addPixelSamples(pixel, min(ADAPTIVE_BATCH, maxSamples - pixelEstimates[pixel].count), camera);
+				}
+
+				mergeThreadStats();
+			}
+		}
+
+		frame.resize(w, h);
+
+		for (int i = 0; i < pixelCount; ++i)
+		{
+			frame.set(i, pixelEstimates[i].getMean());
+		}
+
+		tonemap(bitmap);
+
+		cameraRayCount = samples;
+
+		return samples;
+	}
+
+	// Samples and error estimate of every pixel from the last traceAdaptive()
+	const std::vector<PixelEstimate> &getPixelEstimates() const
+	{
+		return pixelEstimates;
+	}
+
+	// Same image as trace() without FASTER_RENDER up to sampling noise, but every stage runs over a whole batch of rays:
+	// generate camera rays, intersect, sort by material, shade, trace shadow rays, accumulate
+	void traceWavefront(const Camera &camera, size_t traceDepth, const Color &backgroundColor, const Color &ambientLight, int antiAliasScale, UINT32 *bitmap)
+	{
+		this->backgroundColor = backgroundColor;
+		this->ambientLight = ambientLight;
+		this->traceDepth = traceDepth;
+		this->antiAliasScale = antiAliasScale;
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+		int subRayCount = antiAliasScale * antiAliasScale;
+		int batchPixels = max(WAVEFRONT_BATCH_SIZE * getWavefrontThreads() / subRayCount, 1);
+
+		wavefrontStats = WavefrontStats();
+		cameraRayCount = (uint64_t)w * h * subRayCount;
+		renderStats = RenderStats();
+		frame.resize(w, h);
+
+		for (int firstPixel = 0; firstPixel < w * h; firstPixel += batchPixels)
+		{
+			int pixelCount = min(batchPixels, w * h - firstPixel);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+			generateCameraRays(camera, firstPixel, pixelCount);
+			radiance.assign(pixelCount, Color(0, 0, 0));
+			wavefrontStats.generateMs += lapMs(start);
+
+			int bounce = 0;
+
+			for (; pathRays.size() > 0; ++bounce)
+			{
+				wavefrontStats.pathRays += pathRays.size();
+
+				intersectStage();
+				wavefrontStats.intersectMs += lapMs(start);
+
+				sortStage();
+				wavefrontStats.sortMs += lapMs(start);
+
+				shadeStage(firstPixel, bounce);
+				wavefrontStats.shadeMs += lapMs(start);
+
+				shadowStage();
+				wavefrontStats.shadowMs += lapMs(start);
+
+				accumulateStage();
+				wavefrontStats.accumulateMs += lapMs(start);
+			}
+
+			wavefrontStats.bounces = max(wavefrontStats.bounces, bounce);
+
+			for (int i = 0; i < pixelCount; ++i)
+			{
+				frame.set(firstPixel + i, radiance[i] / (float)subRayCount);
+			}
+
+			wavefrontStats.accumulateMs += lapMs(start);
+		}
+
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		tonemap(bitmap);
+		wavefrontStats.accumulateMs += lapMs(start);
+	}
+
+	const WavefrontStats &getWavefrontStats() const
+	{
+		return wavefrontStats;
+	}
+
+private:
+
+	template <typename TileFunc>
+	void forEachTile(int w, int h, int size, TileFunc renderTileFunc)
+	{
+		int threads = threadCount > 0 ? threadCount : TileScheduler::defaultThreadCount();
+		tileScheduler.reset(w, h, size, threads);
+		threads = tileScheduler.getThreadCount();
+
+		cancelled = false;
+		isFirstTileDone = false;
+
+#pragma omp parallel num_threads(threads)
+		{
+#ifdef _OPENMP
+			int thread = omp_get_thread_num();
+#else
+			int thread = 0;
+#endif
+			Tile tile;
+
+			beginThreadStats();
+
+			while (true)
+			{
+				if (cancelFlag != nullptr && cancelFlag->load(std::memory_order_relaxed))
+				{
+					cancelled = true;
+					break;
+				}
+
+				if (!tileScheduler.next(thread, tile)) break;
+
+				renderTileFunc(tile);
+
+				if (!isFirstTileDone.load(std::memory_order_relaxed) && !isFirstTileDone.exchange(true))
+				{
+					firstTileTime = std::chrono::steady_clock::now();
+				}
+			}
+
+			mergeThreadStats();
+		}
+	}
+
+	// Call in parallel region before calling thread renders
+	static void beginThreadStats()
+	{
+#ifdef USE_RENDER_STATS
+		threadRenderStats() = RenderStats();
+#endif
+	}
+
+	// Call in parallel region after calling thread rendered, add its counters to the frame
+	void mergeThreadStats()
+	{
+#ifdef USE_RENDER_STATS
+#pragma omp critical(renderStats)
+		renderStats.merge(threadRenderStats());
+#endif
+	}
+
+	void accumulateTile(const Tile &tile, const Camera &camera)
+	{
+		int w = camera.getWidth();
+		float weight = 1.0f / (progressivePass + 1);
+
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
+		{
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
+			{
+				// first pass samples pixel corner like trace(), later passes jitter inside the pixel
+				// by the first dimension of the pass sample, so passes of a pixel are stratified
+				float jitterX, jitterY;
+				startSample(x + y * w, progressivePass).get2D(jitterX, jitterY);
+
+				if (progressivePass == 0)
+				{
+					jitterX = 0.0f;
+					jitterY = 0.0f;
+				}
+
+				Color sample(0, 0, 0);
+				castTraceRay(camera.getViewPoint(), camera.getViewRay(x + jitterX, y + jitterY), nullptr, false, traceDepth, sample);
+
+				Color &accumulated = accumulation[x + y * w];
+				accumulated += sample;
+
+				frame.set(x + y * w, accumulated * weight);
+			}
+		}
+
+		cameraRayCount += (uint64_t)tile.width * tile.height;
+	}
+
+	// Pixel is owned by the tile of calling thread, start is readPixelCost() before the pixel
+	void addPixelCost(int pixel, uint64_t start)
+	{
+		if (pixelCostMetric != PIXEL_COST_NONE) pixelCosts[pixel] += readPixelCost(pixelCostMetric) - start;
+	}
+
+	// Sample index continues from the samples pixel already has, so later rounds extend its sobol sequence
+	void addPixelSamples(int pixel, int count, const Camera &camera)
+	{
+		int w = camera.getWidth();
+		int x = pixel % w;
+		int y = pixel / w;
+
+		PixelEstimate &estimate = pixelEstimates[pixel];
+
+		for (int i = 0; i < count; ++i)
+		{
+			float jitterX, jitterY;
+			startSample(pixel, estimate.count).get2D(jitterX, jitterY);
+
+			Color sample(0, 0, 0);
+			castTraceRay(camera.getViewPoint(), camera.getViewRay(x + jitterX, y + jitterY), nullptr, false, traceDepth, sample);
+
+			estimate.add(sample);
+		}
+	}
+
+	int getWavefrontThreads() const
+	{
+		return threadCount > 0 ? threadCount : TileScheduler::defaultThreadCount();
+	}
+
+	// Sub pixel rays of pixels [firstPixel, firstPixel + pixelCount), same directions as renderPixel
+	void generateCameraRays(const Camera &camera, int firstPixel, int pixelCount)
+	{
+		int w = camera.getWidth();
+		int subRayCount = antiAliasScale * antiAliasScale;
+
+		pathRays.resize((size_t)pixelCount * subRayCount);
+
+#pragma omp parallel for schedule(static) num_threads(getWavefrontThreads())
+		for (int i = 0; i < pixelCount; ++i)
+		{
+			int x = (firstPixel + i) % w;
+			int y = (firstPixel + i) / w;
+
+			Vec3 nowViewRay = camera.getViewRay(x, y);
+			Vec3 diffX = (camera.getViewRay(x + 1, y) - nowViewRay) / (float)antiAliasScale;
+			Vec3 diffY = (camera.getViewRay(x, y + 1) - nowViewRay) / (float)antiAliasScale;
+
+			for (int subY = 0; subY < antiAliasScale; ++subY)
+			{
+				for (int subX = 0; subX < antiAliasScale; ++subX)
+				{
+					size_t ray = (size_t)i * subRayCount + subY * antiAliasScale + subX;
+					pathRays.setRay(ray, camera.getViewPoint(), nowViewRay + diffY * subY + diffX * subX, Color(1, 1, 1), nullptr, i, traceDepth, false);
+				}
+			}
+		}
+	}
+
+	void intersectStage()
+	{
+		int count = (int)pathRays.size();
+
+#pragma omp parallel num_threads(getWavefrontThreads())
+		{
+			beginThreadStats();
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < count; ++i)
+			{
+				Point3 origin = pathRays.getOrigin(i);
+				Vec3 direct = pathRays.getDirect(i);
+
+				// child rays are counted by type when shading emits them
+				if (pathRays.depth[i] == traceDepth) RENDER_STAT_ADD(cameraRays, 1);
+				RENDER_STAT_MAX(maxDepth, traceDepth - pathRays.depth[i] + 1);
+
+				Intersection intersection;
+				pathRays.objDistance[i] = getNearestObject(origin, direct, pathRays.isInMedium[i] != 0, pathRays.emitObject[i], intersection);
+				pathRays.hitObject[i] = intersection.obj;
+
+				VolumnLight *light = nullptr;
+				pathRays.lightDistance[i] = getNearestLight(origin, direct, light);
+				pathRays.hitLight[i] = light;
+			}
+
+			mergeThreadStats();
+		}
+	}
+
+	// Group rays hitting same kind of surface, so shading runs the same code and object data back to back
+	void sortStage()
+	{
+		int count = (int)pathRays.size();
+		shadeOrder.resize(count);
+
+		for (int i = 0; i < count; ++i)
+		{
+			uint64_t material = 0;		// background and light source only
+			const Object *obj = pathRays.objDistance[i] == NO_INTERSECTION ? nullptr : pathRays.hitObject[i];
+
+			if (obj != nullptr)
+			{
+				// refractive objects shade slowest, then object in scene slot order which keeps mesh triangles together
+				material = (ObjectDispatch::getRefractionRatio(obj, Point3(0, 0, 0)).getStrength() >= 0.1f ? 2ull : 1ull) << 62;
+				material |= (uint64_t)obj->getSceneSlot() << 30;
+			}
+
+			shadeOrder[i] = material | (uint64_t)i;
+		}
+
+		std::sort(shadeOrder.begin(), shadeOrder.end());
+	}
+
+	int getMaxChildRays() const
+	{
+#ifdef USE_MC_REFLECT
+		return 6;		// five diffuse samples and refraction
+#else
+		return 2;		// reflection and refraction
+#endif
+	}
+
+	// Same shading as shadeHit, but child rays and shadow rays go to fixed slots of the next queues,
+	// slots follow shading order so next bounce and shadow stage also see rays grouped by material
+	void shadeStage(int firstPixel, int bounce)
+	{
+		int count = (int)pathRays.size();
+		int maxChild = getMaxChildRays();
+		int lightCount = getLightSampleCount();
+
+		nextRays.resize((size_t)count * maxChild);
+		shadowRays.resize((size_t)count * lightCount);
+
+#pragma omp parallel num_threads(getWavefrontThreads())
+		{
+			beginThreadStats();
+
+#pragma omp for schedule(dynamic, 64)
+			for (int order = 0; order < count; ++order)
+			{
+				int i = (int)(shadeOrder[order] & 0x3fffffff);
+
+				for (int child = 0; child < maxChild; ++child)
+				{
+					nextRays.depth[(size_t)order * maxChild + child] = 0;
+				}
+
+				for (int light = 0; light < lightCount; ++light)
+				{
+					shadowRays.pixel[(size_t)order * lightCount + light] = -1;
+				}
+
+				// rays are shaded in sorted order, a counter based stream keeps the result independent of threads
+				startStream(firstPixel + pathRays.pixel[i], Sampler::hash(order) ^ (uint32_t)bounce);
+				shadeWavefrontRay(i, order, maxChild, lightCount);
+			}
+
+			mergeThreadStats();
+		}
+	}
+
+	void shadeWavefrontRay(int i, int order, int maxChild, int lightCount)
+	{
+		Point3 emitPoint = pathRays.getOrigin(i);
+		Vec3 rayDirect = pathRays.getDirect(i);
+		Color weight = pathRays.weight[i];
+		bool rayInMedium = pathRays.isInMedium[i] != 0;
+		int nowDepth = pathRays.depth[i];
+		int pixel = pathRays.pixel[i];
+
+		float objDistance = pathRays.objDistance[i];
+		float lightDistance = pathRays.lightDistance[i];
+
+		Color &emitted = pathRays.emitted[i];
+		emitted = Color(0, 0, 0);
+
+		if (lightDistance != NO_INTERSECTION && (objDistance == NO_INTERSECTION || objDistance > lightDistance))
+		{
+			emitted += pathRays.hitLight[i]->getLightStrength(rayDirect, lightDistance, rayDirect) * weight;
+		}
+
+		// See though background
+		if (objDistance == NO_INTERSECTION)
+		{
+			if (lightDistance == NO_INTERSECTION)
+			{
+				emitted += backgroundColor * weight;
+			}
+
+			return;
+		}
+
+		Object *hitObject = pathRays.hitObject[i];
+		Intersection intersection(emitPoint + rayDirect * objDistance, hitObject);
+		const Point3 &hitPoint = intersection.intersectionPoint;
+
+		bool totalReflection = false;
+		Vec3 refractionRayDirect(0, 0, 0);
+
+		if (ObjectDispatch::getRefractionRatio(hitObject, hitPoint).getStrength() >= 0.1f) {
+			totalReflection = ObjectDispatch::calcRefractionRay(hitObject, hitPoint, rayDirect, rayInMedium, refractionRayDirect);
+		}
+
+		Vec3 mainReflectionRayDirect(0, 0, 0);
+		ObjectDispatch::calcReflectionRay(hitObject, hitPoint, rayDirect, mainReflectionRayDirect);
+
+		Color reflectionWeight = weight * (totalReflection ? ObjectDispatch::getTotalReflectionRatio(hitObject, hitPoint) : ObjectDispatch::getReflectionRatio(hitObject, hitPoint));
+
+		// direct lighting, light color is added by shadow stage only if light source is visible
+		Vec3 normVector(0, 0, 0);
+		ObjectDispatch::getNormVecAt(hitObject, hitPoint, normVector);
+
+		for (int light = 0; light < lightCount; ++light)
+		{
+			float lightWeight;
+			VolumnLight *vLight = pickLight(hitPoint, light, lightWeight);
+
+			if (vLight == nullptr) continue;
+
+			float u, v;
+			threadSampler().get2D(u, v);
+
+			Vec3 lightDirection(0, 0, 0);
+			float ratio;
+			float lightSourceDistance = vLight->sampleRayVec(hitPoint, u, v, lightDirection, ratio);
+
+			shadowRays.setRay((size_t)order * lightCount + light, hitPoint, lightDirection, normVector, lightSourceDistance, ratio * lightWeight, vLight, hitObject, rayInMedium, reflectionWeight, pixel);
+		}
+
+		emitted += ambientLight * reflectionWeight;
+
+		size_t childSlot = (size_t)order * maxChild;
+
+		if (ObjectDispatch::getRefractionRatio(hitObject, hitPoint).getStrength() >= 0.1f && !totalReflection && nowDepth - 1 > 0)
+		{
+			nextRays.setRay(childSlot++, hitPoint, refractionRayDirect, weight * ObjectDispatch::getRefractionRatio(hitObject, hitPoint), hitObject, pixel, nowDepth - 1, !rayInMedium);
+			RENDER_STAT_ADD(refractionRays, 1);
+		}
+
+#ifdef USE_MC_REFLECT
+		if (nowDepth >= traceDepth - 5 && (pathRays.emitObject[i] == NULL || pathRays.emitObject[i]->getDiffuseFactor() <= 0.01f) && hitObject->getDiffuseFactor() >= 0.01f)
+		{
+			thread_local static TraceStack samples;
+
+			samples.clear();
+			pushHitTask(samples, DIFFUSE_SAMPLE, intersection, mainReflectionRayDirect, rayInMedium, nowDepth, reflectionWeight);
+			deffuseMonteCarlo(samples.pop(), samples);
+
+			while (!samples.isEmpty())
+			{
+				TraceTask task = samples.pop();
+				nextRays.setRay(childSlot++, task.point, task.direct, task.weight, task.obj, pixel, task.depth, task.isInMedium);
+				RENDER_STAT_ADD(diffuseRays, 1);
+			}
+		}
+		else
+#endif
+		if (nowDepth - 1 > 0)
+		{
+			nextRays.setRay(childSlot++, hitPoint, mainReflectionRayDirect, reflectionWeight * (1 - hitObject->getDiffuseFactor()), hitObject, pixel, nowDepth - 1, rayInMedium);
+			RENDER_STAT_ADD(reflectionRays, 1);
+		}
+	}
+
+	void shadowStage()
+	{
+		int count = (int)shadowRays.size();
+		int64_t traced = 0;
+
+		// slots of lights not sampled keep pixel -1 and cast no ray
+#pragma omp parallel num_threads(getWavefrontThreads()) reduction(+:traced)
+		{
+			beginThreadStats();
+
+#pragma omp for schedule(dynamic, 64)
+			for (int i = 0; i < count; ++i)
+			{
+				if (shadowRays.pixel[i] < 0) continue;
+
+				++traced;
+
+				Intersection intersection(shadowRays.getPoint(i), shadowRays.obj[i]);
+				Vec3 lightDirection = shadowRays.getDirect(i);
+
+				if (isShadow(lightDirection, shadowRays.distance[i], intersection, shadowRays.isInMedium[i] != 0) <= 0)
+				{
+					shadowRays.contribution[i] = lightSampleColor(shadowRays.light[i], intersection, shadowRays.getNorm(i), lightDirection, shadowRays.distance[i], shadowRays.ratio[i]) * shadowRays.weight[i];
+				}
+				else
+				{
+					shadowRays.contribution[i] = Color(0, 0, 0);
+				}
+			}
+
+			mergeThreadStats();
+		}
+
+		wavefrontStats.shadowRays += (uint64_t)traced;
+	}
+
+	// Pixels are shared by many rays, so contributions are added in one thread, then next bounce is compacted
+	void accumulateStage()
+	{
+		for (size_t i = 0; i < pathRays.size(); ++i)
+		{
+			radiance[pathRays.pixel[i]] += pathRays.emitted[i];
+		}
+
+		for (size_t i = 0; i < shadowRays.size(); ++i)
+		{
+			if (shadowRays.pixel[i] >= 0)
+			{
+				radiance[shadowRays.pixel[i]] += shadowRays.contribution[i];
+			}
+		}
+
+		nextRays.compact();
+		std::swap(pathRays, nextRays);
+	}
+
+#ifndef FASTER_RENDER
+
+	void renderTile(const Tile &tile, const Camera &camera)
+	{
+		int w = camera.getWidth();
+
+		for (int y = tile.y; y < tile.y + tile.height; ++y)
+		{
+			for (int x = tile.x; x < tile.x + tile.width; ++x)
+			{
+				uint64_t cost = readPixelCost(pixelCostMetric);
+
+				frame.set(x + y * w, renderPixel(x, y, camera));
+				addPixelCost(x + y * w, cost);
+			}
+		}
+
+		cameraRayCount += (uint64_t)tile.width * tile.height * antiAliasScale * antiAliasScale;
+	}
+
+#else
+
+	void renderTile(const Tile &tile, const Camera &camera)
+	{
+		// Render every 4th pixel, then fill the pixels between them at space 2 and 1 by interpolation or tracing.
+		// Every filled pixel casts one unshaded ray first, it takes the average of its neighbours only if it lies
+		// on the same surface as all of them and their colors are close, so thin objects between them are traced.
+		// The tile keeps one extra row and column of its right and bottom neighbour so no pixel depends on
+		// another tile, and tiles need no barrier.
+
+		int w = camera.getWidth();
+		int h = camera.getHeight();
+
+		int stride = tile.width + 1;
+		uint64_t tracedPixel = 0;
+
+		thread_local static std::vector<Color> local;
+		thread_local static std::vector<GBufferSample> gBuffer;
+		local.resize(stride * (tile.height + 1));
+		gBuffer.resize(stride * (tile.height + 1));
+
+		// pixel of tile in image, border included
+		int maxX = min(tile.x + tile.width, w - 1);
+		int maxY = min(tile.y + tile.height, h - 1);
+
+		for (int y = tile.y; y <= maxY; y += 4)
+		{
+			for (int x = tile.x; x <= maxX; x += 4)
+			{
+				int idx = (x - tile.x) + (y - tile.y) * stride;
+				uint64_t cost = readPixelCost(pixelCostMetric);
+
+				primaryHit(camera.getViewPoint(), camera.getViewRay(x, y), gBuffer[idx]);
+				local[idx] = renderPixel(x, y, camera, &gBuffer[idx]);
+
+				// border pixels are counted by the tile owning them
+				if (x < tile.x + tile.width && y < tile.y + tile.height)
+				{
+					++tracedPixel;
+					addPixelCost(x + y * w, cost);
+				}
+			}
+		}
+
+		for (int space = 2; space >= 1; --space)
+		{
+			// border only feeds the final pass
+			int endX = space == 2 ? maxX : tile.x + tile.width - 1;
+			int endY = space == 2 ? maxY : tile.y + tile.height - 1;
+
+			for (int y = tile.y; y <= endY; y += space)
+			{
+				for (int x = tile.x; x <= endX; x += space)
+				{
+					bool betweenX = x % (space << 1) != 0;
+					bool betweenY = y % (space << 1) != 0;
+
+					if (!betweenX && !betweenY) continue;
+
+					int idx = (x - tile.x) + (y - tile.y) * stride;
+
+					// neighbours come from the coarser passes, a pixel at the image edge has none on the far side
+					int neighbours[4];
+					int neighbourCount = 0;
+					bool isInside = (!betweenX || x + space < w) && (!betweenY || y + space < h);
+
+					if (betweenX && betweenY)
+					{
+						neighbours[0] = idx - space - space * stride;
+						neighbours[1] = idx + space - space * stride;
+						neighbours[2] = idx - space + space * stride;
+						neighbours[3] = idx + space + space * stride;
+						neighbourCount = 4;
+					}
+					else
+					{
+						int offset = betweenX ? space : space * stride;
+
+						neighbours[0] = idx - offset;
+						neighbours[1] = idx + offset;
+						neighbourCount = 2;
+					}
+
+					uint64_t cost = readPixelCost(pixelCostMetric);
+
+					primaryHit(camera.getViewPoint(), camera.getViewRay(x, y), gBuffer[idx]);
+
+					bool isOwned = x < tile.x + tile.width && y < tile.y + tile.height;
+
+					if (!isInside || !interpolatePixel(local.data(), gBuffer.data(), idx, neighbours, neighbourCount))
+					{
+						local[idx] = renderPixel(x, y, camera, &gBuffer[idx]);
+						if (isOwned) ++tracedPixel;
+					}
+
+					if (isOwned) addPixelCost(x + y * w, cost);
+				}
+			}
+		}
+
+		for (int y = 0; y < tile.height; ++y)
+		{
+			for (int x = 0; x < tile.width; ++x)
+			{
+				frame.set(tile.x + x + (tile.y + y) * w, local[x + y * stride]);
+			}
+		}
+
+		cameraRayCount += tracedPixel * antiAliasScale * antiAliasScale;
+	}
+
+	// Write average of neighbour colors to colors[idx]
+	// Return false if pixel is not on the same surface as its neighbours or their colors differ
+	static bool interpolatePixel(Color *colors, const GBufferSample *gBuffer, int idx, const int *neighbours, int count)
+	{
+		const GBufferSample *neighbourSamples[4];
+
+		for (int i = 0; i < count; ++i)
+		{
+			neighbourSamples[i] = &gBuffer[neighbours[i]];
+		}
+
+		if (!isSameSurface(gBuffer[idx], neighbourSamples, count)) return false;
+
+		// same surface can still change color, at shadow edges, reflections and checker board
+		// compared in the displayable range, brighter than white all looks the same
+		Color minColor(255, 255, 255);
+		Color maxColor(0, 0, 0);
+		Color sum(0, 0, 0);
+
+		for (int i = 0; i < count; ++i)
+		{
+			const Color &color = colors[neighbours[i]];
+
+			float r = max(min(color.r, 255.0f), 0.0f);
+			float g = max(min(color.g, 255.0f), 0.0f);
+			float b = max(min(color.b, 255.0f), 0.0f);
+
+			minColor.r = min(minColor.r, r); maxColor.r = max(maxColor.r, r);
+			minColor.g = min(minColor.g, g); maxColor.g = max(maxColor.g, g);
+			minColor.b = min(minColor.b, b); maxColor.b = max(maxColor.b, b);
+
+			sum += color;
+		}
+
+		if ((maxColor.r - minColor.r) + (maxColor.g - minColor.g) + (maxColor.b - minColor.b) >= 10) return false;
+
+		colors[idx] = sum / (float)count;
+
+		return true;
+	}
+
+#endif // FASTER_RENDER
+
+	int traceDepth;
+	int antiAliasScale;
+
+	Color ambientLight;
+	Color backgroundColor;
+
+	int tileSize = 16;
+	int threadCount = 0;
+	TileScheduler tileScheduler;
+
+	const std::atomic<bool> *cancelFlag = nullptr;
+	std::atomic<bool> cancelled{ false };
+	std::atomic<bool> isFirstTileDone{ false };
+	std::chrono::steady_clock::time_point firstTileTime;
+
+	std::atomic<uint64_t> cameraRayCount{ 0 };
+	RenderStats renderStats;
+
+	HdrFrame frame;
+	bool isBitmapTopDown = false;
+	ToneMapper toneMapper;
+
+	PixelCostMetric pixelCostMetric = PIXEL_COST_NONE;
+	std::vector<uint64_t> pixelCosts;
+
+	std::vector<Color> accumulation;
+	int progressivePass = 0;
+	uint32_t progressiveCameraVersion = 0;
+
+	TemporalCache temporalCache;
+
+	AdaptiveSettings adaptiveSettings;
+	std::vector<PixelEstimate> pixelEstimates;
+	std::vector<int> adaptivePixels;
+
+	RayQueue pathRays;
+	RayQueue nextRays;
+	ShadowQueue shadowRays;
+	std::vector<uint64_t> shadeOrder;
+	std::vector<Color> radiance;
+	WavefrontStats wavefrontStats;
+	TracePhaseTimes phaseTimes;
 
 	Scence *scence;
 };
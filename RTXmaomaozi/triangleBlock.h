@@ -0,0 +1,327 @@
+#pragma once
+
+#include "object.h"
+#include "rayPacket.h"
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+
+// One kernel call tests TRIANGLE_SIMD_WIDTH triangles against a single ray
+#ifdef __AVX__
+
+#define TRIANGLE_SIMD_WIDTH 8
+
+typedef __m256 TriFloat;
+
+#define triLoad _mm256_loadu_ps
+#define triStore _mm256_storeu_ps
+#define triSet1 _mm256_set1_ps
+#define triAdd _mm256_add_ps
+#define triSub _mm256_sub_ps
+#define triMul _mm256_mul_ps
+#define triDiv _mm256_div_ps
+#define triAnd _mm256_and_ps
+#define triXor _mm256_xor_ps
+#define triGE(a, b) _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define triLE(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define triLT(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define triMoveMask _mm256_movemask_ps
+
+#else
+
+#define TRIANGLE_SIMD_WIDTH 4
+
+typedef __m128 TriFloat;
+
+#define triLoad _mm_loadu_ps
+#define triStore _mm_storeu_ps
+#define triSet1 _mm_set1_ps
+#define triAdd _mm_add_ps
+#define triSub _mm_sub_ps
+#define triMul _mm_mul_ps
+#define triDiv _mm_div_ps
+#define triAnd _mm_and_ps
+#define triXor _mm_xor_ps
+#define triGE _mm_cmpge_ps
+#define triLE _mm_cmple_ps
+#define triLT _mm_cmplt_ps
+#define triMoveMask _mm_movemask_ps
+
+#endif
+
+
+/*
+	Triangles in structure of arrays layout, one slot per object of Scence::getBvhObjects().
+	Slots of other objects hold a degenerate triangle which never intersects.
+*/
+class TriangleBlock
+{
+public:
+	TriangleBlock();
+	~TriangleBlock();
+
+	TriangleBlock(const TriangleBlock &) = delete;
+	TriangleBlock &operator=(const TriangleBlock &) = delete;
+
+	void build(const std::vector<Object *> &objects);
+
+	void clear();
+
+	size_t getMemoryBytes() const;
+
+	// Nearest intersection of slots [first, first + count) closer than tMax, skip slot is ignored
+	// Return slot of nearest triangle and update tMax, -1 if nothing found
+	int intersect(uint32_t first, uint32_t count, const Point3 &emitPoint, const Vec3 &rayVec, uint32_t skip, float &tMax) const;
+
+	// Any triangle of slots [first, first + count) closer than tMax, skip slot is ignored
+	bool occluded(uint32_t first, uint32_t count, const Point3 &emitPoint, const Vec3 &rayVec, uint32_t skip, float tMax) const;
+
+	// One triangle against all lanes in mask, lanes not in mask or without intersection get NO_INTERSECTION
+	void intersectPacket(uint32_t slot, const RayPacket &packet, int mask, float *distance) const;
+
+private:
+	// ray broadcast to every lane
+	struct BlockRay
+	{
+		BlockRay(const Point3 &emitPoint, const Vec3 &rayVec);
+
+		TriFloat dx, dy, dz;
+		TriFloat ox, oy, oz;
+	};
+
+	// Lane mask of slots [base, base + TRIANGLE_SIMD_WIDTH) hit closer than tMax, slots from end are masked out
+	int intersectBlock(uint32_t base, uint32_t end, const BlockRay &ray, uint32_t skip, float tMax, TriFloat &t) const;
+
+	uint32_t slotCount = 0;
+	float *data = nullptr;
+
+	// A, B - A, C - A of every slot
+	float *pointAX = nullptr, *pointAY = nullptr, *pointAZ = nullptr;
+	float *edgeABX = nullptr, *edgeABY = nullptr, *edgeABZ = nullptr;
+	float *edgeACX = nullptr, *edgeACY = nullptr, *edgeACZ = nullptr;
+};
+
+
+inline TriangleBlock::TriangleBlock()
+{
+}
+
+
+inline TriangleBlock::~TriangleBlock()
+{
+	clear();
+}
+
+
+inline void TriangleBlock::clear()
+{
+	if (data != nullptr) _mm_free(data);
+
+	data = nullptr;
+	slotCount = 0;
+}
+
+
+inline void TriangleBlock::build(const std::vector<Object *> &objects)
+{
+	clear();
+
+	slotCount = (uint32_t)objects.size();
+
+	// pad one full vector so the kernel can always load TRIANGLE_SIMD_WIDTH floats
+	size_t stride = (slotCount + TRIANGLE_SIMD_WIDTH + 7) & ~(size_t)7;
+
+	data = (float *)_mm_malloc(sizeof(float) * stride * 9, 32);
+	memset(data, 0, sizeof(float) * stride * 9);
+
+	pointAX = data;
+	pointAY = data + stride;
+	pointAZ = data + stride * 2;
+	edgeABX = data + stride * 3;
+	edgeABY = data + stride * 4;
+	edgeABZ = data + stride * 5;
+	edgeACX = data + stride * 6;
+	edgeACY = data + stride * 7;
+	edgeACZ = data + stride * 8;
+
+	for (uint32_t i = 0; i < slotCount; ++i)
+	{
+		if (objects[i]->getType() != OBJECT_TRIANGLE) continue;
+
+		const Triangle *triangle = static_cast<const Triangle *>(objects[i]);
+
+		pointAX[i] = triangle->getPointA().x;
+		pointAY[i] = triangle->getPointA().y;
+		pointAZ[i] = triangle->getPointA().z;
+		edgeABX[i] = triangle->getEdgeAB().x;
+		edgeABY[i] = triangle->getEdgeAB().y;
+		edgeABZ[i] = triangle->getEdgeAB().z;
+		edgeACX[i] = triangle->getEdgeAC().x;
+		edgeACY[i] = triangle->getEdgeAC().y;
+		edgeACZ[i] = triangle->getEdgeAC().z;
+	}
+}
+
+
+inline size_t TriangleBlock::getMemoryBytes() const
+{
+	size_t stride = (slotCount + TRIANGLE_SIMD_WIDTH + 7) & ~(size_t)7;
+	return data != nullptr ? sizeof(float) * stride * 9 : 0;
+}
+
+
+inline TriangleBlock::BlockRay::BlockRay(const Point3 &emitPoint, const Vec3 &rayVec)
+{
+	dx = triSet1(rayVec.x);
+	dy = triSet1(rayVec.y);
+	dz = triSet1(rayVec.z);
+
+	ox = triSet1(emitPoint.x);
+	oy = triSet1(emitPoint.y);
+	oz = triSet1(emitPoint.z);
+}
+
+
+inline int TriangleBlock::intersectBlock(uint32_t base, uint32_t end, const BlockRay &ray, uint32_t skip, float tMax, TriFloat &t) const
+{
+	/*
+	Moller-Trumbore Algorithm, same steps as Triangle::getIntersection
+	*/
+
+	TriFloat abx = triLoad(edgeABX + base), aby = triLoad(edgeABY + base), abz = triLoad(edgeABZ + base);
+	TriFloat acx = triLoad(edgeACX + base), acy = triLoad(edgeACY + base), acz = triLoad(edgeACZ + base);
+
+	// P = rayVec x AC
+	TriFloat px = triSub(triMul(ray.dy, acz), triMul(acy, ray.dz));
+	TriFloat py = triSub(triMul(ray.dz, acx), triMul(acz, ray.dx));
+	TriFloat pz = triSub(triMul(ray.dx, acy), triMul(acx, ray.dy));
+
+	TriFloat determinant = triAdd(triAdd(triMul(abx, px), triMul(aby, py)), triMul(abz, pz));
+
+	// T = emitPoint - A, flipped with the sign of determinant
+	TriFloat signBit = triAnd(determinant, triSet1(-0.0f));
+	TriFloat tx = triXor(triSub(ray.ox, triLoad(pointAX + base)), signBit);
+	TriFloat ty = triXor(triSub(ray.oy, triLoad(pointAY + base)), signBit);
+	TriFloat tz = triXor(triSub(ray.oz, triLoad(pointAZ + base)), signBit);
+
+	determinant = triXor(determinant, signBit);
+
+	TriFloat u = triAdd(triAdd(triMul(tx, px), triMul(ty, py)), triMul(tz, pz));
+
+	// Q = T x AB
+	TriFloat qx = triSub(triMul(ty, abz), triMul(aby, tz));
+	TriFloat qy = triSub(triMul(tz, abx), triMul(abz, tx));
+	TriFloat qz = triSub(triMul(tx, aby), triMul(abx, ty));
+
+	TriFloat v = triAdd(triAdd(triMul(ray.dx, qx), triMul(ray.dy, qy)), triMul(ray.dz, qz));
+	t = triDiv(triAdd(triAdd(triMul(acx, qx), triMul(acy, qy)), triMul(acz, qz)), determinant);
+
+	TriFloat zero = triSet1(0.0f);
+
+	TriFloat valid = triGE(determinant, triSet1(EPSILON));
+	valid = triAnd(valid, triGE(u, zero));
+	valid = triAnd(valid, triLE(u, determinant));
+	valid = triAnd(valid, triGE(v, zero));
+	valid = triAnd(valid, triLE(triAdd(u, v), determinant));
+	valid = triAnd(valid, triGE(t, triSet1(10 * EPSILON)));
+	valid = triAnd(valid, triLT(t, triSet1(tMax)));
+
+	int mask = triMoveMask(valid);
+
+	if (end - base < TRIANGLE_SIMD_WIDTH) mask &= (1 << (end - base)) - 1;
+	if (skip - base < TRIANGLE_SIMD_WIDTH) mask &= ~(1 << (skip - base));
+
+	return mask;
+}
+
+
+inline int TriangleBlock::intersect(uint32_t first, uint32_t count, const Point3 &emitPoint, const Vec3 &rayVec, uint32_t skip, float &tMax) const
+{
+	int nearest = -1;
+
+	BlockRay ray(emitPoint, rayVec);
+	TriFloat t;
+
+	for (uint32_t base = first; base < first + count; base += TRIANGLE_SIMD_WIDTH)
+	{
+		int mask = intersectBlock(base, first + count, ray, skip, tMax, t);
+
+		if (mask == 0) continue;
+
+		float distance[TRIANGLE_SIMD_WIDTH];
+		triStore(distance, t);
+
+		for (int lane = 0; lane < TRIANGLE_SIMD_WIDTH; ++lane)
+		{
+			if ((mask & (1 << lane)) && distance[lane] < tMax)
+			{
+				tMax = distance[lane];
+				nearest = base + lane;
+			}
+		}
+	}
+
+	return nearest;
+}
+
+
+inline bool TriangleBlock::occluded(uint32_t first, uint32_t count, const Point3 &emitPoint, const Vec3 &rayVec, uint32_t skip, float tMax) const
+{
+	BlockRay ray(emitPoint, rayVec);
+	TriFloat t;
+
+	for (uint32_t base = first; base < first + count; base += TRIANGLE_SIMD_WIDTH)
+	{
+		// any lane is enough, distance is never read back
+		if (intersectBlock(base, first + count, ray, skip, tMax, t) != 0) return true;
+	}
+
+	return false;
+}
+
+
+inline void TriangleBlock::intersectPacket(uint32_t slot, const RayPacket &packet, int mask, float *distance) const
+{
+	__m128 dx = _mm_load_ps(packet.directX);
+	__m128 dy = _mm_load_ps(packet.directY);
+	__m128 dz = _mm_load_ps(packet.directZ);
+
+	__m128 abx = _mm_set1_ps(edgeABX[slot]), aby = _mm_set1_ps(edgeABY[slot]), abz = _mm_set1_ps(edgeABZ[slot]);
+	__m128 acx = _mm_set1_ps(edgeACX[slot]), acy = _mm_set1_ps(edgeACY[slot]), acz = _mm_set1_ps(edgeACZ[slot]);
+
+	// P = rayVec x AC
+	__m128 px = _mm_sub_ps(_mm_mul_ps(dy, acz), _mm_mul_ps(acy, dz));
+	__m128 py = _mm_sub_ps(_mm_mul_ps(dz, acx), _mm_mul_ps(acz, dx));
+	__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, acy), _mm_mul_ps(acx, dy));
+
+	__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(abx, px), _mm_mul_ps(aby, py)), _mm_mul_ps(abz, pz));
+
+	// T = emitPoint - A, flipped with the sign of determinant
+	__m128 signBit = _mm_and_ps(determinant, _mm_set1_ps(-0.0f));
+	__m128 tx = _mm_xor_ps(_mm_sub_ps(_mm_load_ps(packet.originX), _mm_set1_ps(pointAX[slot])), signBit);
+	__m128 ty = _mm_xor_ps(_mm_sub_ps(_mm_load_ps(packet.originY), _mm_set1_ps(pointAY[slot])), signBit);
+	__m128 tz = _mm_xor_ps(_mm_sub_ps(_mm_load_ps(packet.originZ), _mm_set1_ps(pointAZ[slot])), signBit);
+
+	determinant = _mm_xor_ps(determinant, signBit);
+
+	__m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz));
+
+	// Q = T x AB
+	__m128 qx = _mm_sub_ps(_mm_mul_ps(ty, abz), _mm_mul_ps(aby, tz));
+	__m128 qy = _mm_sub_ps(_mm_mul_ps(tz, abx), _mm_mul_ps(abz, tx));
+	__m128 qz = _mm_sub_ps(_mm_mul_ps(tx, aby), _mm_mul_ps(abx, ty));
+
+	__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz));
+	__m128 t = _mm_div_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(acx, qx), _mm_mul_ps(acy, qy)), _mm_mul_ps(acz, qz)), determinant);
+
+	__m128 valid = RayPacket::laneMask(mask);
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(determinant, _mm_set1_ps(EPSILON)));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(u, _mm_setzero_ps()));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(u, determinant));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(v, _mm_setzero_ps()));
+	valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), determinant));
+	valid = _mm_and_ps(valid, _mm_cmpge_ps(t, _mm_set1_ps(10 * EPSILON)));
+
+	_mm_storeu_ps(distance, _mm_or_ps(_mm_and_ps(valid, t), _mm_andnot_ps(valid, _mm_set1_ps(NO_INTERSECTION))));
+}
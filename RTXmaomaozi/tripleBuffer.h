@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+	Frame handoff between one render thread and one present thread without locks.
+	Renderer owns the back buffer and presenter the front buffer, the third one sits between them.
+	publish() swaps back with the middle one, acquire() swaps the middle one with front if it holds
+	a newer frame, so neither side ever sees a buffer the other is writing.
+*/
+class TripleBuffer
+{
+public:
+	TripleBuffer(int width, int height);
+	~TripleBuffer();
+
+	TripleBuffer(const TripleBuffer &) = delete;
+	TripleBuffer &operator=(const TripleBuffer &) = delete;
+
+	// Render thread: buffer to write the next frame into, rows top down as shown. Another buffer after every publish()
+	UINT32 *getBackBuffer();
+
+	// Render thread: make back buffer the newest frame
+	// Return sequence number of the frame, starting from 1
+	uint64_t publish();
+
+	// Present thread: newest published frame, rows top down
+	// sequence is its number, 0 while nothing was published
+	const UINT32 *acquire(uint64_t &sequence);
+
+	int getWidth() const;
+	int getHeight() const;
+
+private:
+	// bit of middle set while it holds a frame presenter has not taken
+	static const uint32_t FRESH_BIT = 4;
+
+	int width;
+	int height;
+
+	UINT32 *buffers[3];
+	uint64_t sequences[3];
+
+	int backIndex = 0;			// render thread only
+	int frontIndex = 1;			// present thread only
+	std::atomic<uint32_t> middle{ 2 };
+
+	uint64_t publishedSequence = 0;
+};
+
+
+inline TripleBuffer::TripleBuffer(int width, int height) : width(width), height(height)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		buffers[i] = (UINT32 *)_mm_malloc(sizeof(UINT32) * width * height, 64);
+		memset(buffers[i], 0, sizeof(UINT32) * width * height);
+		sequences[i] = 0;
+	}
+}
+
+
+inline TripleBuffer::~TripleBuffer()
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		_mm_free(buffers[i]);
+	}
+}
+
+
+inline UINT32 *TripleBuffer::getBackBuffer()
+{
+	return buffers[backIndex];
+}
+
+
+inline uint64_t TripleBuffer::publish()
+{
+	sequences[backIndex] = ++publishedSequence;
+
+	// release the frame and take whatever buffer presenter left in the middle
+	uint32_t old = middle.exchange((uint32_t)backIndex | FRESH_BIT, std::memory_order_acq_rel);
+	backIndex = old & 3;
+
+	return publishedSequence;
+}
+
+
+inline const UINT32 *TripleBuffer::acquire(uint64_t &sequence)
+{
+	if (middle.load(std::memory_order_relaxed) & FRESH_BIT)
+	{
+		uint32_t old = middle.exchange((uint32_t)frontIndex, std::memory_order_acq_rel);
+		frontIndex = old & 3;
+	}
+
+	sequence = sequences[frontIndex];
+
+	return buffers[frontIndex];
+}
+
+
+inline int TripleBuffer::getWidth() const
+{
+	return width;
+}
+
+
+inline int TripleBuffer::getHeight() const
+{
+	return height;
+}
@@ -18,7 +18,7 @@
 	   Angle is define as conter-clockwise ( While one axis point to right and one point to sky)
 */
 
-float mySqrt(float x)
+inline float mySqrt(float x)
 {
 	float a = x;
 	unsigned int i = *(unsigned int *)&x;
@@ -0,0 +1,229 @@
+#pragma once
+
+#include "vec.h"
+#include "color.h"
+#include "object.h"
+#include "light.h"
+#include <vector>
+#include <chrono>
+
+
+// Camera rays per thread in one wavefront batch, small enough that the queues stay in cache
+#define WAVEFRONT_BATCH_SIZE (1 << 12)
+
+
+/*
+	Rays of one bounce in structure of arrays layout, every stage only touch the arrays it need.
+	Slot with depth 0 is empty, it is removed by compact().
+*/
+struct RayQueue
+{
+	size_t size() const
+	{
+		return pixel.size();
+	}
+
+	void resize(size_t count)
+	{
+		originX.resize(count);
+		originY.resize(count);
+		originZ.resize(count);
+
+		directX.resize(count);
+		directY.resize(count);
+		directZ.resize(count);
+
+		weight.resize(count);
+		emitObject.resize(count);
+		pixel.resize(count);
+		depth.resize(count);
+		isInMedium.resize(count);
+
+		objDistance.resize(count);
+		hitObject.resize(count);
+		lightDistance.resize(count);
+		hitLight.resize(count);
+		emitted.resize(count);
+	}
+
+	void setRay(size_t i, const Point3 &origin, const Vec3 &direct, const Color &rayWeight, Object *emitFrom, int rayPixel, int rayDepth, bool rayInMedium)
+	{
+		originX[i] = origin.x;
+		originY[i] = origin.y;
+		originZ[i] = origin.z;
+
+		directX[i] = direct.x;
+		directY[i] = direct.y;
+		directZ[i] = direct.z;
+
+		weight[i] = rayWeight;
+		emitObject[i] = emitFrom;
+		pixel[i] = rayPixel;
+		depth[i] = rayDepth;
+		isInMedium[i] = rayInMedium;
+	}
+
+	Point3 getOrigin(size_t i) const
+	{
+		return Point3(originX[i], originY[i], originZ[i]);
+	}
+
+	Vec3 getDirect(size_t i) const
+	{
+		return Vec3(directX[i], directY[i], directZ[i]);
+	}
+
+	// Move non empty slots to the front keeping their order, return ray count left
+	size_t compact()
+	{
+		size_t count = 0;
+
+		for (size_t i = 0; i < size(); ++i)
+		{
+			if (depth[i] <= 0) continue;
+
+			if (count != i)
+			{
+				setRay(count, getOrigin(i), getDirect(i), weight[i], emitObject[i], pixel[i], depth[i], isInMedium[i] != 0);
+			}
+
+			++count;
+		}
+
+		resize(count);
+		return count;
+	}
+
+	// ray
+	std::vector<float> originX, originY, originZ;
+	std::vector<float> directX, directY, directZ;
+	std::vector<Color> weight;				// product of all ratios between ray and camera
+	std::vector<Object *> emitObject;
+	std::vector<int> pixel;					// pixel index in batch
+	std::vector<int> depth;
+	std::vector<char> isInMedium;
+
+	// written by intersect stage
+	std::vector<float> objDistance;
+	std::vector<Object *> hitObject;
+	std::vector<float> lightDistance;
+	std::vector<VolumnLight *> hitLight;
+
+	// written by shade stage, light emission, background and ambient already weighted
+	std::vector<Color> emitted;
+};
+
+
+// Shadow rays toward sampled light points, slot with pixel -1 is empty
+struct ShadowQueue
+{
+	size_t size() const
+	{
+		return pixel.size();
+	}
+
+	void resize(size_t count)
+	{
+		pointX.resize(count);
+		pointY.resize(count);
+		pointZ.resize(count);
+
+		directX.resize(count);
+		directY.resize(count);
+		directZ.resize(count);
+
+		normX.resize(count);
+		normY.resize(count);
+		normZ.resize(count);
+
+		distance.resize(count);
+		ratio.resize(count);
+		light.resize(count);
+		obj.resize(count);
+		isInMedium.resize(count);
+
+		weight.resize(count);
+		pixel.resize(count);
+		contribution.resize(count);
+	}
+
+	void setRay(size_t i, const Point3 &point, const Vec3 &direct, const Vec3 &norm, float lightSourceDistance, float sampleRatio, VolumnLight *lightSource, Object *hitObject, bool rayInMedium, const Color &rayWeight, int rayPixel)
+	{
+		pointX[i] = point.x;
+		pointY[i] = point.y;
+		pointZ[i] = point.z;
+
+		directX[i] = direct.x;
+		directY[i] = direct.y;
+		directZ[i] = direct.z;
+
+		normX[i] = norm.x;
+		normY[i] = norm.y;
+		normZ[i] = norm.z;
+
+		distance[i] = lightSourceDistance;
+		ratio[i] = sampleRatio;
+		light[i] = lightSource;
+		obj[i] = hitObject;
+		isInMedium[i] = rayInMedium;
+
+		weight[i] = rayWeight;
+		pixel[i] = rayPixel;
+	}
+
+	Point3 getPoint(size_t i) const
+	{
+		return Point3(pointX[i], pointY[i], pointZ[i]);
+	}
+
+	Vec3 getDirect(size_t i) const
+	{
+		return Vec3(directX[i], directY[i], directZ[i]);
+	}
+
+	Vec3 getNorm(size_t i) const
+	{
+		return Vec3(normX[i], normY[i], normZ[i]);
+	}
+
+	std::vector<float> pointX, pointY, pointZ;
+	std::vector<float> directX, directY, directZ;
+	std::vector<float> normX, normY, normZ;		// surface normal at point
+	std::vector<float> distance;
+	std::vector<float> ratio;					// sample ratio from sampleRayVec
+	std::vector<VolumnLight *> light;
+	std::vector<Object *> obj;					// object shadow ray start on
+	std::vector<char> isInMedium;
+
+	std::vector<Color> weight;					// reflection weight of the hit point
+	std::vector<int> pixel;
+
+	// written by shadow stage, zero if light source is blocked
+	std::vector<Color> contribution;
+};
+
+
+// Time spent in each stage by the last wavefront trace
+struct WavefrontStats
+{
+	double generateMs = 0;
+	double intersectMs = 0;
+	double sortMs = 0;
+	double shadeMs = 0;
+	double shadowMs = 0;
+	double accumulateMs = 0;		// add contributions to pixels and compact next bounce
+
+	uint64_t pathRays = 0;			// camera rays included
+	uint64_t shadowRays = 0;
+	int bounces = 0;				// max bounce reached by any batch
+};
+
+
+// Milliseconds since start, and restart from now
+inline double lapMs(std::chrono::steady_clock::time_point &start)
+{
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	double ms = std::chrono::duration<double, std::milli>(now - start).count();
+	start = now;
+	return ms;
+}
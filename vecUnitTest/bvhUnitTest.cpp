@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../RTXmaomaozi/bvh.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace vecUnitTest
+{
+	TEST_CLASS(BvhUnitTest)
+	{
+	public:
+
+		TEST_METHOD(TestRefitAfterMove)
+		{
+			std::vector<AABB> bounds = gridBounds();
+			Bvh bvh;
+			bvh.build(bounds);
+
+			bounds[5] = box(20.0f, 3.0f, -4.0f, 2.0f);
+
+			// no subtree can grow past a huge ratio, so update() only refits
+			Assert::AreEqual(0, bvh.update(bounds, {}, {}, 1e30f));
+			checkBounds(bvh, bounds, 0);
+			Assert::AreEqual(22.0f, bvh.getNode(0).boundMax[0]);
+		}
+
+		TEST_METHOD(TestRebuildDegraded)
+		{
+			std::vector<AABB> bounds = gridBounds();
+			Bvh bvh;
+			bvh.build(bounds);
+
+			// scatter a few boxes across the grid so their leaves grow far past their built cost
+			bounds[0] = box(14.0f, 14.0f, 14.0f, 0.5f);
+			bounds[21] = box(-6.0f, 9.0f, 1.0f, 0.5f);
+			bounds[42] = box(3.0f, -7.0f, 12.0f, 0.5f);
+			bounds[63] = box(-2.0f, -2.0f, -2.0f, 0.5f);
+
+			Assert::IsTrue(bvh.update(bounds, {}, {}, BVH_REBUILD_RATIO) > 0);
+			checkBounds(bvh, bounds, 0);
+
+			// hits after update() match those of a full build of the moved boxes
+			Bvh built;
+			built.build(bounds);
+
+			for (int i = 0; i < 32; ++i)
+			{
+				for (int j = 0; j < 32; ++j)
+				{
+					// fan of rays from one point, wide enough to reach the scattered boxes too
+					Point3 origin(3.0f, 3.0f, -20.0f);
+					Vec3 direct(-11.0f + i * 0.75f, -11.0f + j * 0.75f, 27.0f);
+					direct.normalize();
+
+					uint32_t hit, builtHit;
+					float t = nearestHit(bvh, bounds, origin, direct, hit);
+					float builtT = nearestHit(built, bounds, origin, direct, builtHit);
+
+					Assert::AreEqual(builtT, t);
+					Assert::AreEqual(builtHit, hit);
+				}
+			}
+		}
+
+	private:
+		static AABB box(float x, float y, float z, float halfSize)
+		{
+			return AABB(Point3(x - halfSize, y - halfSize, z - halfSize), Point3(x + halfSize, y + halfSize, z + halfSize));
+		}
+
+		// 4x4x4 unit boxes two apart
+		static std::vector<AABB> gridBounds()
+		{
+			std::vector<AABB> bounds;
+
+			for (int i = 0; i < 64; ++i)
+			{
+				bounds.push_back(box(2.0f * (i % 4), 2.0f * (i / 4 % 4), 2.0f * (i / 16), 0.5f));
+			}
+
+			return bounds;
+		}
+
+		static BvhNode toNode(const AABB &bound)
+		{
+			BvhNode node = {};
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				node.boundMin[axis] = bound.get_top_left()[axis];
+				node.boundMax[axis] = bound.get_down_right()[axis];
+			}
+
+			return node;
+		}
+
+		// Every reachable node must be the exact union of its children or leaf primitives
+		static void checkBounds(const Bvh &bvh, const std::vector<AABB> &bounds, uint32_t nodeIdx)
+		{
+			const BvhNode &node = bvh.getNode(nodeIdx);
+			float boundMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+			float boundMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+			if (node.isLeaf())
+			{
+				for (uint32_t i = node.leftFirst; i < node.leftFirst + node.count; ++i)
+				{
+					BvhNode prim = toNode(bounds[bvh.getPrimitiveOrder()[i]]);
+					grow(boundMin, boundMax, prim);
+				}
+			}
+			else
+			{
+				for (uint32_t child = node.leftFirst; child < node.leftFirst + 2; ++child)
+				{
+					checkBounds(bvh, bounds, child);
+					grow(boundMin, boundMax, bvh.getNode(child));
+				}
+			}
+
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				Assert::AreEqual(boundMin[axis], node.boundMin[axis]);
+				Assert::AreEqual(boundMax[axis], node.boundMax[axis]);
+			}
+		}
+
+		static void grow(float boundMin[3], float boundMax[3], const BvhNode &node)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				boundMin[axis] = min(boundMin[axis], node.boundMin[axis]);
+				boundMax[axis] = max(boundMax[axis], node.boundMax[axis]);
+			}
+		}
+
+		static float nearestHit(const Bvh &bvh, const std::vector<AABB> &bounds, const Point3 &origin, const Vec3 &direct, uint32_t &hit)
+		{
+			BvhRay ray(origin, direct);
+			float tMax = FLT_MAX;
+			hit = UINT32_MAX;
+
+			bvh.traverse(origin, direct, tMax, [&](uint32_t first, uint32_t count, float &tLeaf)
+			{
+				for (uint32_t i = first; i < first + count; ++i)
+				{
+					uint32_t prim = bvh.getPrimitiveOrder()[i];
+					float t = Bvh::intersectNode(toNode(bounds[prim]), ray, tLeaf);
+
+					// equal distances go to the lower index, leaf order must not decide
+					if (t < tLeaf || (t == tLeaf && t < FLT_MAX && prim < hit))
+					{
+						tLeaf = t;
+						hit = prim;
+					}
+				}
+
+				return false;
+			});
+
+			return tMax;
+		}
+	};
+}
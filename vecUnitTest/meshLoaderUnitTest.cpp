@@ -0,0 +1,133 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../RTXmaomaozi/meshLoader.h"
+
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace vecUnitTest
+{
+	TEST_CLASS(MeshLoaderUnitTest)
+	{
+	public:
+
+		TEST_METHOD(TestPlyAsciiQuad)
+		{
+			IndexedMesh mesh;
+
+			Assert::IsTrue(load(asciiHeader + "0 0 0\n1 0 0\n1 1 0\n0 1 0\n3 0 1 2\n3 0 2 3\n", mesh));
+			Assert::AreEqual((size_t)4, mesh.getVertexCount());
+			Assert::AreEqual((size_t)2, mesh.getTriangleCount());
+		}
+
+		TEST_METHOD(TestPlyAsciiBadFaceLine)
+		{
+			IndexedMesh mesh;
+
+			// a good line after the bad one must not make the chunk valid again
+			Assert::IsFalse(load(asciiHeader + "0 0 0\n1 0 0\n1 1 0\n0 1 0\nbad line\n4 0 1 2 3\n", mesh));
+		}
+
+		TEST_METHOD(TestPlyAsciiIndexOutOfRange)
+		{
+			IndexedMesh mesh;
+
+			Assert::IsFalse(load(asciiHeader + "0 0 0\n1 0 0\n1 1 0\n0 1 0\n3 0 1 2\n3 0 1 4\n", mesh));
+		}
+
+		TEST_METHOD(TestPlyAsciiTooManyCorners)
+		{
+			IndexedMesh mesh;
+
+			Assert::IsFalse(load(asciiHeader + "0 0 0\n1 0 0\n1 1 0\n0 1 0\n3 0 1 2\n100000000 0 1 2\n", mesh));
+			Assert::IsFalse(load(asciiHeader + "0 0 0\n1 0 0\n1 1 0\n0 1 0\n3 0 1 2\n99999999999999999999 0 1 2\n", mesh));
+		}
+
+		TEST_METHOD(TestPlyBinaryQuad)
+		{
+			IndexedMesh mesh;
+
+			Assert::IsTrue(load(binaryQuad(), mesh));
+			Assert::AreEqual((size_t)4, mesh.getVertexCount());
+			Assert::AreEqual((size_t)2, mesh.getTriangleCount());
+		}
+
+		TEST_METHOD(TestPlyBinaryTruncated)
+		{
+			std::string quad = binaryQuad();
+
+			// cut inside the scalar property, the list length and the list of the face
+			for (size_t cut = 1; cut <= 1 + 1 + 16; ++cut)
+			{
+				IndexedMesh mesh;
+				Assert::IsFalse(load(quad.substr(0, quad.size() - cut), mesh));
+			}
+		}
+
+		TEST_METHOD(TestPlyBinaryListPastEnd)
+		{
+			std::string quad = binaryQuad();
+			IndexedMesh mesh;
+
+			// list length of the face is 255 instead of 4
+			quad[quad.size() - 17] = (char)255;
+			Assert::IsFalse(load(quad, mesh));
+		}
+
+		TEST_METHOD(TestPlyBinaryEmptyLastFace)
+		{
+			std::string quad = binaryQuad();
+			IndexedMesh mesh;
+
+			// second face has no corners and ends the file right after its length
+			quad.replace(quad.find("element face 1"), 14, "element face 2");
+			quad.push_back(0);
+			quad.push_back(0);
+
+			Assert::IsTrue(load(quad, mesh));
+			Assert::AreEqual((size_t)2, mesh.getTriangleCount());
+		}
+
+	private:
+		const std::string asciiHeader =
+			"ply\nformat ascii 1.0\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\n"
+			"element face 2\nproperty list uchar int vertex_indices\nend_header\n";
+
+		// Quad of 4 float vertices and one face, the face has a uchar flag before its list
+		static std::string binaryQuad()
+		{
+			std::string data =
+				"ply\nformat binary_little_endian 1.0\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\n"
+				"element face 1\nproperty uchar flags\nproperty list uchar int vertex_indices\nend_header\n";
+
+			const float vertices[] = { 0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0 };
+			const int32_t indices[] = { 0, 1, 2, 3 };
+
+			data.append((const char *)vertices, sizeof(vertices));
+			data.push_back(0);
+			data.push_back(4);
+			data.append((const char *)indices, sizeof(indices));
+
+			return data;
+		}
+
+		static bool load(const std::string &data, IndexedMesh &mesh)
+		{
+			const char *path = "meshLoaderUnitTest.ply";
+
+			FILE *file = fopen(path, "wb");
+			Assert::IsTrue(file != nullptr);
+			fwrite(data.data(), 1, data.size(), file);
+			fclose(file);
+
+			MeshLoadStats stats;
+			bool isLoaded = MeshLoader::load(path, mesh, stats);
+
+			remove(path);
+			return isLoaded;
+		}
+	};
+}
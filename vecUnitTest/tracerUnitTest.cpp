@@ -0,0 +1,63 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+
+#include "../RTXmaomaozi/tracer.h"
+#include "../RTXmaomaozi/demoScence.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+
+namespace vecUnitTest
+{
+	TEST_CLASS(AdaptiveSamplingUnitTest)
+	{
+	public:
+
+		TEST_METHOD(TestBudgetBelowOneSample)
+		{
+			Assert::AreEqual((uint64_t)0, traceWithBudget(0.5f));
+			Assert::IsTrue(tracer.getPixelEstimates().empty());
+		}
+
+		TEST_METHOD(TestBudgetBelowTwoSamples)
+		{
+			Assert::AreEqual((uint64_t)0, traceWithBudget(1.5f));
+			Assert::IsTrue(tracer.getPixelEstimates().empty());
+		}
+
+		TEST_METHOD(TestBudgetKept)
+		{
+			uint64_t samples = traceWithBudget(2.5f);
+
+			Assert::IsTrue(samples > 0);
+			Assert::IsTrue(samples <= (uint64_t)(2.5f * width * height));
+
+			for (const PixelEstimate &estimate : tracer.getPixelEstimates())
+			{
+				Assert::IsTrue(estimate.count >= 2);
+			}
+		}
+
+	private:
+		static const int width = 32;
+		static const int height = 18;
+
+		uint64_t traceWithBudget(float samplesPerPixel)
+		{
+			Scence scence;
+			buildDemoScence(scence, false);
+			scence.build();
+
+			AdaptiveSettings settings;
+			settings.sampleBudget = (uint64_t)(samplesPerPixel * width * height);
+
+			tracer.setSence(&scence);
+			tracer.setAdaptiveSettings(settings);
+
+			std::vector<UINT32> bitmap(width * height);
+			return tracer.traceAdaptive(createDemoCamera(width, height), 4, Color(0, 0, 0), Color(0, 0, 0), bitmap.data());
+		}
+
+		Tracer tracer;
+	};
+}